@@ -30,6 +30,12 @@ This file is part of AYAB.
 #include "./debug.h"
 #include "./settings.h"
 
+#include "./txqueue.h"
+#include "./linecodec.h"
+#include "./rowcache.h"
+#include "./scheduler.h"
+#include "./histogram.h"
+#include "./trace.h"
 #include "./knitter.h"
 
 /*
@@ -41,15 +47,52 @@ This file is part of AYAB.
  *  DECLARATIONS
  */ 
 Knitter     *knitter;
-byte        lineBuffer[25];
 
 SLIPPacketSerial packetSerial;
+TxQueue          txQueue(&packetSerial);
+RowCache         rowCache;
+Scheduler        scheduler;
 
 /*! Mapping of Pin EncA to its ISR
  *
  */
 void isr_encA() {
+  unsigned long _start = micros();
   knitter->isr();
+  latencies[LatencyIsr].add(micros() - _start);
+  scheduler.trigger(TaskFsm);
+}
+
+/*
+ * Tasks of the main loop
+ */
+void task_fsm() {
+  unsigned long _start = micros();
+  knitter->fsm();
+  latencies[LatencyFsm].add(micros() - _start);
+}
+
+void task_rx() {
+  unsigned long _start = micros();
+  packetSerial.update();
+  latencies[LatencyRx].add(micros() - _start);
+}
+
+void task_tx() {
+  txQueue.update();
+}
+
+void task_beeper() {
+  knitter->updateBeeper();
+}
+
+void task_telemetry() {
+  knitter->reportState();
+  logger.flush(&txQueue);
+}
+
+void task_adc() {
+  knitter->updateHallValues();
 }
 
 /*
@@ -60,50 +103,224 @@ void h_reqStart(const uint8_t* buffer, size_t size) {
   byte _stopNeedle  = (byte)buffer[2];
   bool _continuousReportingEnabled = (bool)buffer[3];
 
-  // TODO verify operation
-  // memset(lineBuffer,0,sizeof(lineBuffer));
-  // temporary solution:
-  for (int i = 0; i < 25; i++) {
-    lineBuffer[i] = 0xFF;
+  // Optional line source, followed by its parameters
+  LineSource_t _lineSource = SourceHost;
+  if (size > 4) {
+    _lineSource = (LineSource_t)buffer[4];
   }
 
-  bool _success = knitter->startOperation(_startNeedle,
-                                          _stopNeedle,
-                                          _continuousReportingEnabled,
-                                          &(lineBuffer[0]));
+  bool _success = true;
+  if (SourceMotif == _lineSource) {
+    _success = knitter->setMotif(&buffer[5], size - 5);
+  } else if (SourceColour == _lineSource) {
+    _success = knitter->setColours(&buffer[5], size - 5);
+  } else if (SourceLace == _lineSource) {
+    _success = knitter->setLace(&buffer[5], size - 5);
+  } else if (SourceStored == _lineSource && size >= 7) {
+    // Pattern known by its hash, streamed by the host if not stored
+    uint16 _hash = ((uint16)buffer[5] << 8) | buffer[6];
+    if (!knitter->selectPattern(_hash)) {
+      _lineSource = SourceHost;
+    }
+  }
 
-  uint8_t payload[2];
+  _success = _success && knitter->startOperation(_startNeedle,
+                                                 _stopNeedle,
+                                                 _continuousReportingEnabled,
+                                                 _lineSource);
+
+  if (_success) {
+    // First run of the operation, no need to wait for the encoder
+    scheduler.trigger(TaskFsm);
+  }
+
+  uint8_t payload[3];
   payload[0] = cnfStart_msgid;
   payload[1] = _success;
-  packetSerial.send(payload, 2);
+  // No reqLine to answer, the lines come from the stored pattern
+  payload[2] = _success && (SourceStored == _lineSource);
+  txQueue.send(payload, 3);
 }
 
 
+/*! Hand a decoded line to the knitter, keep it for cnfLineCached */
+bool h_acceptLine(byte lineNumber, const byte* line, byte flags,
+                  byte startNeedle, byte stopNeedle) {
+  if (knitter->setNextLine(lineNumber, line, startNeedle, stopNeedle)) {
+    // Line was accepted
+    rowCache.insert(line, lineNumber, startNeedle, stopNeedle);
+    if (bitRead(flags, 0)) {
+      knitter->setLastLine();
+    }
+    return true;
+  }
+  return false;
+}
+
+/*! Common part of all cnfLine variants
+ *
+ *  id, lineNumber, <encoded line>, flags, crc8
+ */
+bool h_cnfLineEncoded(const uint8_t* buffer, size_t size,
+                      bool (*decode)(const uint8_t*, size_t, byte*),
+                      byte startNeedle = 0,
+                      byte stopNeedle = NUM_NEEDLES - 1) {
+  if (size < 4) {
+    return false;
+  }
+  byte _lineNumber = (byte)buffer[1];
+  byte _flags      = (byte)buffer[size-2];
+
+  // TODO insert CRC8 check
+
+  // Decode into a copy, so that neither malformed nor rejected
+  // lines touch the last accepted line
+  byte _line[LINEBUFFER_LEN];
+  memcpy(_line, knitter->getLastLine(), LINEBUFFER_LEN);
+  if (!decode(&buffer[2], size - 4, _line)) {
+    return false;
+  }
+
+  return h_acceptLine(_lineNumber, _line, _flags, startNeedle, stopNeedle);
+}
+
 void h_cnfLine(const uint8_t* buffer, size_t size) {
-  byte _lineNumber = 0;
-  byte _flags = 0;
-  byte _crc8  = 0;
-  bool _flagLastLine = false;
+  h_cnfLineEncoded(buffer, size, &LineCodec::decodeRaw);
+}
 
-  _lineNumber = (byte)buffer[1];
+void h_cnfLineXor(const uint8_t* buffer, size_t size) {
+  h_cnfLineEncoded(buffer, size, &LineCodec::decodeXor);
+}
+
+void h_cnfLineRle(const uint8_t* buffer, size_t size) {
+  h_cnfLineEncoded(buffer, size, &LineCodec::decodeRle);
+}
+
+void h_cnfLineRange(const uint8_t* buffer, size_t size) {
+  // A window outside of the job's needles is requested again
+  if (size >= 4) {
+    h_cnfLineEncoded(buffer, size, &LineCodec::decodeRange,
+                     (byte)buffer[2], (byte)buffer[3]);
+  }
+}
 
-  for (int i = 0; i < 25; i++) {
-    // Values have to be inverted because of needle states
-    lineBuffer[i] = ~(byte)buffer[i+2];
+/*! Line from the row cache, addressed by the line number it was
+ *  accepted as and its hash, knitted within the needles it was sent with
+ *
+ *  On a miss the line is requested again, to be sent in full.
+ */
+void h_cnfLineCached(const uint8_t* buffer, size_t size) {
+  // id, lineNumber, cached line number, hash (2), flags, crc8
+  if (7 != size) {
+    return;
   }
-  _flags = (byte)buffer[27];
-  _crc8  = (byte)buffer[28];
 
   // TODO insert CRC8 check
 
-  if (knitter->setNextLine(_lineNumber)) {
-    // Line was accepted
-    _flagLastLine = bitRead(_flags, 0);
-    if ( _flagLastLine ) {
+  const CachedRow_t* _row =
+    rowCache.lookup((byte)buffer[2], ((uint16)buffer[3] << 8) | buffer[4]);
+  if (NULL == _row) {
+    knitter->requestLineAgain();
+    return;
+  }
+  h_acceptLine((byte)buffer[1], _row->data, (byte)buffer[5],
+               _row->startNeedle, _row->stopNeedle);
+}
+
+void h_cnfLineColour(const uint8_t* buffer, size_t size) {
+  // id, lineNumber, colour indices, flags, crc8
+  if (size < 4) {
+    return;
+  }
+
+  // TODO insert CRC8 check
+
+  if (knitter->setColourLine((byte)buffer[1], &buffer[2], size - 4)) {
+    if (bitRead(buffer[size-2], 0)) {
+      knitter->setLastLine();
+    }
+  }
+}
+
+void h_cnfLineLace(const uint8_t* buffer, size_t size) {
+  // id, lineNumber, lace chart, flags, crc8
+  if (size < 4) {
+    return;
+  }
+
+  // TODO insert CRC8 check
+
+  if (knitter->setLaceLine((byte)buffer[1], &buffer[2], size - 4)) {
+    if (bitRead(buffer[size-2], 0)) {
       knitter->setLastLine();
     }
   }
- }
+}
+
+void h_reqStore(const uint8_t* buffer, size_t size) {
+  // id, offset (2), pattern container bytes
+  if (size < 3) {
+    return;
+  }
+  uint16 _offset = ((uint16)buffer[1] << 8) | buffer[2];
+  bool _success  = knitter->storePattern(_offset, &buffer[3], size - 3);
+
+  uint16 _received = knitter->getStoredBytes();
+  uint8_t payload[4];
+  payload[0] = cnfStore_msgid;
+  payload[1] = _success;
+  payload[2] = highByte(_received);
+  payload[3] = lowByte(_received);
+  txQueue.send(payload, 4);
+}
+
+void h_reqQueue(const uint8_t* buffer, size_t size) {
+  // id alone clears the queue
+  bool _success = true;
+  if (1 == size) {
+    knitter->clearJobs();
+  } else if (size >= 5) {
+    Job_t _job;
+    _job.startNeedle = (byte)buffer[1];
+    _job.stopNeedle  = (byte)buffer[2];
+    _job.carriage    = (Carriage_t)buffer[3];
+    _job.lineSource  = (LineSource_t)buffer[4];
+    _job.hasHash     = (size >= 7);
+    _job.hash        = _job.hasHash ? ((uint16)buffer[5] << 8) | buffer[6] : 0;
+    _success = knitter->queueJob(&_job);
+  } else {
+    _success = false;
+  }
+
+  uint8_t payload[3];
+  payload[0] = cnfQueue_msgid;
+  payload[1] = _success;
+  payload[2] = knitter->getQueuedJobs();
+  txQueue.send(payload, 3);
+}
+
+void h_cnfLineBatch(const uint8_t* buffer, size_t size) {
+  // id, first line, count, count * LINEBUFFER_LEN bytes, flags
+  if (size < 4 || size != 4 + (size_t)buffer[2] * LINEBUFFER_LEN) {
+    return;
+  }
+  byte _lineNumber = (byte)buffer[1];
+  byte _count      = (byte)buffer[2];
+  byte _flags      = (byte)buffer[size-1];
+
+  byte _line[LINEBUFFER_LEN];
+  for (byte i = 0; i < _count; i++) {
+    LineCodec::decodeRaw(&buffer[3 + i*LINEBUFFER_LEN], LINEBUFFER_LEN, _line);
+    if (!knitter->setNextLine(_lineNumber + i, _line)) {
+      // No room left, the host continues with the next reqLine
+      return;
+    }
+    rowCache.insert(_line, _lineNumber + i, 0, NUM_NEEDLES - 1);
+  }
+  if (bitRead(_flags, 0)) {
+    knitter->setLastLine();
+  }
+}
 
 void h_reqInfo() {
   uint8_t payload[4];
@@ -111,7 +328,7 @@ void h_reqInfo() {
   payload[1] = API_VERSION;
   payload[2] = FW_VERSION_MAJ;
   payload[3] = FW_VERSION_MIN;
-  packetSerial.send(payload, 4);
+  txQueue.send(payload, 4);
 }
 
 void h_reqTest() {
@@ -120,7 +337,149 @@ void h_reqTest() {
     uint8_t payload[2];
     payload[0] = cnfTest_msgid;
     payload[1] = _success;
-    packetSerial.send(payload, 2);
+    txQueue.send(payload, 2);
+}
+
+
+void h_reqStats(const uint8_t* buffer, size_t size) {
+  if (size < 2) {
+    return;
+  }
+
+  uint8_t payload[TXQUEUE_MAX_PAYLOAD];
+  payload[0] = cnfStats_msgid;
+  payload[1] = buffer[1];
+
+  switch (buffer[1]) {
+    case StatsRowCache:
+      payload[2] = highByte(rowCache.getHits());
+      payload[3] = lowByte(rowCache.getHits());
+      payload[4] = highByte(rowCache.getMisses());
+      payload[5] = lowByte(rowCache.getMisses());
+      payload[6] = rowCache.getUsed();
+      payload[7] = ROWCACHE_SLOTS;
+      rowCache.resetStats();
+      txQueue.send(payload, 8);
+      break;
+
+    case StatsScheduler:
+      for (byte i = 0; i < scheduler.getCount(); i++) {
+        TaskId_t _task = (TaskId_t)i;
+        payload[2 + 4*i] = highByte(scheduler.getMisses(_task));
+        payload[3 + 4*i] = lowByte(scheduler.getMisses(_task));
+        payload[4 + 4*i] = highByte(scheduler.getOverruns(_task));
+        payload[5 + 4*i] = lowByte(scheduler.getOverruns(_task));
+      }
+      txQueue.send(payload, 2 + 4 * scheduler.getCount());
+      scheduler.resetStats();
+      break;
+
+    case StatsSleep:
+      payload[2]  = highByte(scheduler.getSleeps());
+      payload[3]  = lowByte(scheduler.getSleeps());
+      payload[4]  = highByte(scheduler.getWakeups());
+      payload[5]  = lowByte(scheduler.getWakeups());
+      payload[6]  = highByte(scheduler.getWakeLatencyAvg());
+      payload[7]  = lowByte(scheduler.getWakeLatencyAvg());
+      payload[8]  = highByte(scheduler.getWakeLatencyMax());
+      payload[9]  = lowByte(scheduler.getWakeLatencyMax());
+      payload[10] = highByte(scheduler.getLatencyMax());
+      payload[11] = lowByte(scheduler.getLatencyMax());
+      txQueue.send(payload, 12);
+      scheduler.resetSleepStats();
+      break;
+
+    case StatsTxQueue:
+      payload[2] = highByte(txQueue.getDropped());
+      payload[3] = lowByte(txQueue.getDropped());
+      txQueue.resetStats();
+      txQueue.send(payload, 4);
+      break;
+
+    case StatsLatencyIsr:
+    case StatsLatencyFsm:
+    case StatsLatencySolenoids:
+    case StatsLatencyRx:
+    case StatsLatencyEdge: {
+      Histogram* _histogram = &latencies[buffer[1] - StatsLatencyIsr];
+      // The ISR adds to its histogram at any time
+      noInterrupts();
+      for (byte i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        payload[2 + 2*i] = highByte(_histogram->getCount(i));
+        payload[3 + 2*i] = lowByte(_histogram->getCount(i));
+      }
+      _histogram->reset();
+      interrupts();
+      txQueue.send(payload, 2 + 2 * HISTOGRAM_BUCKETS);
+      break;
+    }
+
+    default:
+      // Unknown group, answer with no counters
+      txQueue.send(payload, 2);
+      break;
+  }
+}
+
+
+void h_reqPing(const uint8_t* buffer, size_t size) {
+  unsigned long _received = micros();
+  if (size < 5) {
+    return;
+  }
+
+  uint8_t payload[CNFPING_LEN];
+  payload[0] = cnfPing_msgid;
+  memcpy(&payload[1], &buffer[1], 4);
+  for (byte i = 0; i < 4; i++) {
+    payload[8 - i] = (_received >> (8 * i)) & 0xFF;
+  }
+  // Transmit time is filled in by the queue
+  memset(&payload[CNFPING_SENT], 0, 4);
+  txQueue.send(payload, CNFPING_LEN, TxHigh, CNFPING_SENT);
+}
+
+
+void h_reqReport(const uint8_t* buffer, size_t size) {
+  // id, fields, min interval (2, ms)
+  bool _success = false;
+  if (size >= 4) {
+    _success = knitter->setReporting((byte)buffer[1],
+                                     ((uint16)buffer[2] << 8) | buffer[3]);
+  }
+
+  uint8_t payload[2];
+  payload[0] = cnfReport_msgid;
+  payload[1] = _success;
+  txQueue.send(payload, 2);
+}
+
+
+void h_reqTrace(const uint8_t* buffer, size_t size) {
+  bool _success = false;
+  byte _events  = 0;
+
+#ifdef TRACE
+  if (size >= 2 && TraceFreeze == buffer[1]) {
+    // The host fetches the events with TraceFetch
+    _events  = trace.freeze();
+    _success = true;
+  } else if (size >= 2 && TraceRestart == buffer[1]) {
+    trace.restart();
+    _success = true;
+  } else if (size >= 3 && TraceFetch == buffer[1]) {
+    // Answered by indTrace alone
+    if (trace.dump(&txQueue, buffer[2])) {
+      return;
+    }
+  }
+#endif
+
+  uint8_t payload[3];
+  payload[0] = cnfTrace_msgid;
+  payload[1] = _success;
+  payload[2] = _events;
+  txQueue.send(payload, 3);
 }
 
 
@@ -142,6 +501,42 @@ void onPacketReceived(const uint8_t* buffer, size_t size)
       h_cnfLine(buffer, size);
       break;
 
+    case cnfLineCached_msgid:
+      h_cnfLineCached(buffer, size);
+      break;
+
+    case cnfLineColour_msgid:
+      h_cnfLineColour(buffer, size);
+      break;
+
+    case cnfLineLace_msgid:
+      h_cnfLineLace(buffer, size);
+      break;
+
+    case cnfLineBatch_msgid:
+      h_cnfLineBatch(buffer, size);
+      break;
+
+    case cnfLineXor_msgid:
+      h_cnfLineXor(buffer, size);
+      break;
+
+    case cnfLineRle_msgid:
+      h_cnfLineRle(buffer, size);
+      break;
+
+    case cnfLineRange_msgid:
+      h_cnfLineRange(buffer, size);
+      break;
+
+    case reqStore_msgid:
+      h_reqStore(buffer, size);
+      break;
+
+    case reqQueue_msgid:
+      h_reqQueue(buffer, size);
+      break;
+
     case reqInfo_msgid:
       h_reqInfo();
       break;
@@ -150,6 +545,22 @@ void onPacketReceived(const uint8_t* buffer, size_t size)
       h_reqTest();
       break;
 
+    case reqStats_msgid:
+      h_reqStats(buffer, size);
+      break;
+
+    case reqPing_msgid:
+      h_reqPing(buffer, size);
+      break;
+
+    case reqReport_msgid:
+      h_reqReport(buffer, size);
+      break;
+
+    case reqTrace_msgid:
+      h_reqTrace(buffer, size);
+      break;
+
     default:
       h_unrecognized();
       break;
@@ -177,11 +588,29 @@ void setup() {
   // Attaching ENC_PIN_A(=2), Interrupt No. 0
   attachInterrupt(0, isr_encA, CHANGE);
 
-  knitter = new Knitter(&packetSerial);
+  knitter = new Knitter(&txQueue);
+
+  // In order of TaskId_t, i.e. of priority
+  //                             period, deadline, budget (us)
+  scheduler.add(&task_fsm,        10000,     1000,    500);
+  scheduler.add(&task_rx,         10000,     5000,   2000);
+  scheduler.add(&task_tx,             0,     5000,    500);
+  scheduler.add(&task_beeper,     10000,    10000,    100);
+  scheduler.add(&task_telemetry,  50000,    50000,    500);
+  scheduler.add(&task_adc,        20000,    20000,    300);
 }
 
 
 void loop() {
-  knitter->fsm();
-  packetSerial.update();
+  if (Serial.available()) {
+    scheduler.trigger(TaskRx);
+  }
+  // Only once there is room, a full TX buffer wakes us byte by byte
+  if (txQueue.isReady()) {
+    scheduler.trigger(TaskTx);
+  }
+  if (!scheduler.update()) {
+    // Woken by the encoder, the UART or the timer tick
+    scheduler.idle();
+  }
 }
@@ -24,7 +24,8 @@ This file is part of AYAB.
 
 
 Beeper::Beeper() {
-  // Intentionally left blank
+  m_toggles    = 0;
+  m_lastToggle = 0;
 }
 
 
@@ -43,15 +44,28 @@ void Beeper::endWork() {
 }
 
 
+void Beeper::update() {
+  if (0 == m_toggles || millis() - m_lastToggle < BEEPDELAY) {
+    return;
+  }
+  m_lastToggle = millis();
+
+  m_toggles--;
+  if (0 == m_toggles) {
+    analogWrite(PIEZO_PIN, 255);
+  } else {
+    analogWrite(PIEZO_PIN, (m_toggles & 1) ? 20 : 0);
+  }
+}
+
+
 /*
  * PRIVATE METHODS
  */
 void Beeper::beep(byte length) {
-  for (int i=0; i < length; i++) {
-    analogWrite(PIEZO_PIN, 0);
-    delay(BEEPDELAY);
-    analogWrite(PIEZO_PIN, 20);
-    delay(BEEPDELAY);
+  if (0 == m_toggles) {
+    // Silence after the last beep
+    m_toggles = 1;
   }
-  analogWrite(PIEZO_PIN, 255);
+  m_toggles += 2 * length;
 }
@@ -27,6 +27,9 @@ This file is part of AYAB.
 
 /*!
  *  Class to actuate a beeper connected to PIEZO_PIN
+ *
+ *  Beeps are played by update() without blocking,
+ *  requested beeps are played one after the other.
  */
 class Beeper {
  public:
@@ -39,7 +42,13 @@ class Beeper {
   /*! Beep to indicate the end the knitting pattern */
   void endWork();
 
+  /*! Advance the beeps being played, to be called regularly */
+  void update();
+
  private:
+  byte          m_toggles;  // piezo changes left, the last one silences it
+  unsigned long m_lastToggle;
+
   void beep(byte length);
 };
 
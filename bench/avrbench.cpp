@@ -0,0 +1,627 @@
+// avrbench.cpp
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+/*
+ * Cycle counts of the firmware image under simavr
+ *
+ *   avrbench [-o results.json] ayab.elf scenario.scn
+ *
+ * Runs the AVR firmware on a simulated ATmega328P at 16MHz with two
+ * MCP23008 on the I2C bus, plays a scenario of carriage moves and
+ * host messages, and reports the cycles spent in the functions below
+ * and the latency from an encoder edge to the solenoid write on I2C,
+ * as JSON, along with the section sizes of the image from avr-size.
+ * Entry points come from avr-nm, a call ends when its return
+ * address is reached with the stack back where it was, so interrupts
+ * taken meanwhile are included.
+ *
+ * Scenario commands, one per line, # starts a comment:
+ *   carriage K|L speed   carriage for move, needles/s
+ *   move position        move the carriage there, wait until it stops
+ *   wait us              let the firmware run
+ *   send hex...          send a packet to the firmware
+ *   waitfor id [us]      run until the firmware has sent a packet with id
+ *                        since the last waitfor
+ *   lines count [us]     answer reqLine with random lines, after us
+ *
+ * The carriage model is the one of the host build, host/carriage.cpp,
+ * here running on the simulated AVR's pins and ADC.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fnmatch.h>
+#include <deque>
+#include <vector>
+#include <string>
+
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_irq.h"
+#include "sim_time.h"
+#include "sim_cycle_timers.h"
+#include "avr_ioport.h"
+#include "avr_adc.h"
+#include "avr_uart.h"
+#include "avr_twi.h"
+
+#include "../host/carriage.h"
+#include "Encoding/SLIP.h"
+
+#define BENCH_FREQUENCY 16000000
+#define BENCH_VCC       5000      // mV
+#define UART_BYTE_TIME  87        // us, 115200 baud
+#define MCP23008_ADDR   0x20      // 7 bit address of the first expander
+#define MCP23008_GPIO   0x09
+#define MCP23008_IOCON  0x05
+
+/*! Function to measure, the first demangled symbol matching pattern,
+ *  a shell wildcard pattern as for fnmatch()
+ */
+typedef struct Measured {
+  const char*       label;
+  const char*       pattern;
+  uint32_t          entry;   // byte address, 0 if not found
+  uint32_t          calls;
+  avr_cycle_count_t min;
+  avr_cycle_count_t max;
+  avr_cycle_count_t total;
+} Measured_t;
+
+static Measured_t s_measured[] = {
+  {"Knitter::isr()",            "Knitter::isr()"},
+  {"Knitter::state_operate()",  "Knitter::state_operate()"},
+  {"Solenoids::write()",        "Solenoids::write(unsigned int)"},
+  {"SLIP encode (send)",        "PacketSerial_<SLIP*>::send(*"},
+  {"SLIP decode (update)",      "PacketSerial_<SLIP*>::update()*"},
+};
+#define MEASURED_COUNT (sizeof(s_measured) / sizeof(s_measured[0]))
+
+/*! Call in progress */
+typedef struct Frame {
+  Measured_t*       measured;
+  avr_cycle_count_t start;
+  uint16_t          sp;
+  uint32_t          ret;  // byte address
+} Frame_t;
+
+/*! Sections of the image, bytes */
+typedef struct ImageSize {
+  uint32_t text;
+  uint32_t data;
+  uint32_t bss;
+} ImageSize_t;
+
+typedef struct EdgeLatency {
+  uint32_t          count;
+  avr_cycle_count_t min;
+  avr_cycle_count_t max;
+  avr_cycle_count_t total;
+} EdgeLatency_t;
+
+static avr_t*               s_avr;
+static std::vector<Frame_t> s_frames;
+
+// Board around the AVR
+static uint8_t  s_pins[HAL_PINS];
+static int      s_analog[8];
+static void   (*s_event)() = NULL;
+static uint8_t  s_mcp[2][16];
+static uint8_t  s_mcpPointer[2];
+static int      s_mcpSelected = -1;
+static bool     s_mcpFirstByte;
+
+// Host side
+static std::deque<uint8_t> s_uartIn;
+static std::vector<uint8_t> s_frame;
+static bool     s_seen[256];  // ids received since the last waitfor
+static int      s_lines  = 0;
+static uint32_t s_lineLatency = 0;
+
+// Edge to solenoid write
+static EdgeLatency_t     s_edgeLatency = {0, (avr_cycle_count_t)-1, 0, 0};
+static avr_cycle_count_t s_edgeCycle;
+static bool              s_edgePending = false;
+
+static ImageSize_t s_size = {0, 0, 0};
+
+
+/*
+ * Board of the host build's hal.h, on the simulated AVR
+ */
+uint64_t hal_now() {
+  return avr_cycles_to_usec(s_avr, s_avr->cycle);
+}
+
+static avr_cycle_count_t eventTimer(avr_t*, avr_cycle_count_t, void*) {
+  void (*_event)() = s_event;
+  s_event = NULL;
+  if (NULL != _event) {
+    _event();
+  }
+  return 0;
+}
+
+void hal_schedule(uint64_t at, void (*callback)()) {
+  uint64_t _now = hal_now();
+  s_event = callback;
+  avr_cycle_timer_cancel(s_avr, eventTimer, NULL);
+  avr_cycle_timer_register_usec(s_avr, (at > _now) ? at - _now : 0,
+                                eventTimer, NULL);
+}
+
+void hal_setPin(uint8_t pin, uint8_t value) {
+  // Encoder inputs are on port D
+  if (pin < 8) {
+    if (ENC_PIN_A == pin && s_pins[pin] != value) {
+      // An edge without solenoid write is not counted
+      s_edgeCycle   = s_avr->cycle;
+      s_edgePending = true;
+    }
+    s_pins[pin] = value;
+    avr_raise_irq(avr_io_getirq(s_avr, AVR_IOCTL_IOPORT_GETIRQ('D'), pin),
+                  value);
+  }
+}
+
+uint8_t hal_getPin(uint8_t pin) {
+  return (pin < HAL_PINS) ? s_pins[pin] : 0;
+}
+
+void hal_setAnalog(uint8_t pin, int value) {
+  byte _channel = (pin >= A0) ? pin - A0 : pin;
+  if (_channel < 8) {
+    s_analog[_channel] = value;
+    avr_raise_irq(avr_io_getirq(s_avr, AVR_IOCTL_ADC_GETIRQ,
+                                ADC_IRQ_ADC0 + _channel),
+                  value * BENCH_VCC / 1023);
+  }
+}
+
+int analogRead(uint8_t pin) {
+  byte _channel = (pin >= A0) ? pin - A0 : pin;
+  return (_channel < 8) ? s_analog[_channel] : 0;
+}
+
+
+/*
+ * Two MCP23008 port expanders, registers with auto increment
+ */
+static void twiMessage(struct avr_irq_t*, uint32_t value, void*) {
+  avr_irq_t*        _input = avr_io_getirq(s_avr, AVR_IOCTL_TWI_GETIRQ(0),
+                                           TWI_IRQ_INPUT);
+  avr_twi_msg_irq_t _message;
+  _message.u.v = value;
+  uint8_t _msg  = _message.u.twi.msg;
+  uint8_t _addr = _message.u.twi.addr;
+
+  if (_msg & TWI_COND_STOP) {
+    s_mcpSelected = -1;
+  }
+  if (_msg & TWI_COND_START) {
+    s_mcpSelected = -1;
+    int _device = (_addr >> 1) - MCP23008_ADDR;
+    if (0 <= _device && _device < 2) {
+      s_mcpSelected  = _device;
+      s_mcpFirstByte = true;
+      avr_raise_irq(_input, avr_twi_irq_msg(TWI_COND_ACK, _addr, 1));
+    }
+  }
+  if (s_mcpSelected < 0) {
+    return;
+  }
+
+  if (_msg & TWI_COND_WRITE) {
+    avr_raise_irq(_input, avr_twi_irq_msg(TWI_COND_ACK, _addr, 1));
+    uint8_t _data = _message.u.twi.data;
+    if (s_mcpFirstByte) {
+      s_mcpPointer[s_mcpSelected] = _data & 0x0F;
+      s_mcpFirstByte = false;
+      return;
+    }
+    uint8_t _reg = s_mcpPointer[s_mcpSelected];
+    s_mcp[s_mcpSelected][_reg] = (MCP23008_IOCON == _reg) ? _data & 0x3E
+                                                           : _data;
+    s_mcpPointer[s_mcpSelected] = (_reg + 1) & 0x0F;
+
+    if (MCP23008_GPIO == _reg && s_edgePending) {
+      avr_cycle_count_t _latency = s_avr->cycle - s_edgeCycle;
+      s_edgePending = false;
+      s_edgeLatency.count++;
+      s_edgeLatency.total += _latency;
+      s_edgeLatency.min    = min(s_edgeLatency.min, _latency);
+      s_edgeLatency.max    = max(s_edgeLatency.max, _latency);
+    }
+  }
+  if (_msg & TWI_COND_READ) {
+    uint8_t _reg = s_mcpPointer[s_mcpSelected];
+    s_mcpPointer[s_mcpSelected] = (_reg + 1) & 0x0F;
+    avr_raise_irq(_input, avr_twi_irq_msg(TWI_COND_READ, _addr,
+                                          s_mcp[s_mcpSelected][_reg]));
+  }
+}
+
+
+/*
+ * Serial link
+ */
+static avr_cycle_count_t uartTimer(avr_t* avr, avr_cycle_count_t when,
+                                   void*) {
+  if (s_uartIn.empty()) {
+    return 0;
+  }
+  avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'),
+                              UART_IRQ_INPUT), s_uartIn.front());
+  s_uartIn.pop_front();
+  return s_uartIn.empty() ? 0
+                          : when + avr_usec_to_cycles(avr, UART_BYTE_TIME);
+}
+
+static void send(const uint8_t* payload, size_t size, uint32_t delay = 0) {
+  uint8_t _encoded[2 * 64 + 2];
+  size_t  _size = SLIP::encode(payload, size, _encoded);
+  _encoded[_size++] = SLIP::END;
+  bool _idle = s_uartIn.empty();
+  s_uartIn.insert(s_uartIn.end(), _encoded, _encoded + _size);
+  if (_idle) {
+    avr_cycle_timer_register_usec(s_avr, delay, uartTimer, NULL);
+  }
+}
+
+static void sendLine(uint8_t lineNumber) {
+  uint8_t payload[LINEBUFFER_LEN + 4];
+  payload[0] = cnfLine_msgid;
+  payload[1] = lineNumber;
+  for (int i = 0; i < LINEBUFFER_LEN; i++) {
+    payload[2 + i] = rand() & 0xFF;
+  }
+  payload[LINEBUFFER_LEN + 2] = (lineNumber + 1 >= s_lines) ? 1 : 0;
+  payload[LINEBUFFER_LEN + 3] = 0;
+  send(payload, sizeof(payload), s_lineLatency);
+}
+
+static void received(const uint8_t* payload, size_t size) {
+  if (0 == size) {
+    return;
+  }
+  s_seen[payload[0]] = true;
+  if (reqLine_msgid == payload[0] && size > 1 && payload[1] < s_lines) {
+    sendLine(payload[1]);
+  }
+}
+
+static void uartOutput(struct avr_irq_t*, uint32_t value, void*) {
+  if (SLIP::END != value) {
+    s_frame.push_back(value);
+  } else if (!s_frame.empty()) {
+    std::vector<uint8_t> _payload(s_frame.size());
+    received(&_payload[0], SLIP::decode(&s_frame[0], s_frame.size(),
+                                        &_payload[0]));
+    s_frame.clear();
+  }
+}
+
+
+/*
+ * Measurement
+ */
+static bool findSymbols(const char* elf) {
+  std::string _command = std::string("avr-nm -C --defined-only ") + elf;
+  FILE* _nm = popen(_command.c_str(), "r");
+  if (NULL == _nm) {
+    return false;
+  }
+  char _line[512];
+  while (fgets(_line, sizeof(_line), _nm)) {
+    unsigned _address;
+    char     _type;
+    int      _offset;
+    if (2 != sscanf(_line, "%x %c %n", &_address, &_type, &_offset)
+        || ('T' != _type && 't' != _type && 'W' != _type && 'w' != _type)) {
+      continue;
+    }
+    char* _name = _line + _offset;
+    _name[strcspn(_name, "\n")] = '\0';
+    for (size_t i = 0; i < MEASURED_COUNT; i++) {
+      Measured_t* _measured = &s_measured[i];
+      if (0 == _measured->entry
+          && 0 == fnmatch(_measured->pattern, _name, 0)) {
+        _measured->entry = _address;
+      }
+    }
+  }
+  return 0 == pclose(_nm);
+}
+
+static bool findSize(const char* elf) {
+  std::string _command = std::string("avr-size -A ") + elf;
+  FILE* _size = popen(_command.c_str(), "r");
+  if (NULL == _size) {
+    return false;
+  }
+  char _line[256];
+  while (fgets(_line, sizeof(_line), _size)) {
+    char     _section[64];
+    unsigned _bytes;
+    if (2 != sscanf(_line, "%63s %u", _section, &_bytes)) {
+      continue;
+    }
+    if (0 == strcmp(_section, ".text")) {
+      s_size.text = _bytes;
+    } else if (0 == strcmp(_section, ".data")) {
+      s_size.data = _bytes;
+    } else if (0 == strcmp(_section, ".bss")) {
+      s_size.bss = _bytes;
+    }
+  }
+  return 0 == pclose(_size) && 0 != s_size.text;
+}
+
+static uint16_t getSp() {
+  return s_avr->data[R_SPL] | (s_avr->data[R_SPH] << 8);
+}
+
+static void checkCalls() {
+  uint32_t _pc = s_avr->pc;
+
+  // Returned?
+  while (!s_frames.empty() && _pc == s_frames.back().ret
+         && getSp() == s_frames.back().sp + 2) {
+    Frame_t*          _frame  = &s_frames.back();
+    avr_cycle_count_t _cycles = s_avr->cycle - _frame->start;
+    _frame->measured->calls++;
+    _frame->measured->total += _cycles;
+    _frame->measured->min    = min(_frame->measured->min, _cycles);
+    _frame->measured->max    = max(_frame->measured->max, _cycles);
+    s_frames.pop_back();
+  }
+
+  // Entered?
+  for (size_t i = 0; i < MEASURED_COUNT; i++) {
+    if (0 != s_measured[i].entry && _pc == s_measured[i].entry) {
+      // Return address as pushed by call, high byte first
+      uint16_t _sp = getSp();
+      Frame_t  _frame;
+      _frame.measured = &s_measured[i];
+      _frame.start    = s_avr->cycle;
+      _frame.sp       = _sp;
+      _frame.ret      = ((s_avr->data[_sp + 1] << 8) | s_avr->data[_sp + 2]) * 2;
+      s_frames.push_back(_frame);
+    }
+  }
+}
+
+/*! Run until done() holds or for us at most, false on timeout or crash */
+static bool run(bool (*done)(), uint64_t us) {
+  uint64_t _end = hal_now() + us;
+  while (NULL == done || !done()) {
+    if (hal_now() >= _end) {
+      return NULL == done;
+    }
+    checkCalls();
+    int _state = avr_run(s_avr);
+    if (cpu_Done == _state || cpu_Crashed == _state) {
+      fprintf(stderr, "firmware stopped\n");
+      return false;
+    }
+  }
+  return true;
+}
+
+static VirtualCarriage* s_carriage = NULL;
+static unsigned         s_waitId;
+
+static bool isStopped()  { return !s_carriage->isMoving(); }
+static bool isReceived() { return s_seen[s_waitId & 0xFF]; }
+
+
+/*
+ * Scenario
+ */
+static bool play(FILE* scenario) {
+  char _line[256];
+  int  _number = 0;
+  while (fgets(_line, sizeof(_line), scenario)) {
+    _number++;
+    char* _comment = strchr(_line, '#');
+    if (NULL != _comment) {
+      *_comment = '\0';
+    }
+    char _command[16];
+    int  _offset;
+    if (1 != sscanf(_line, "%15s %n", _command, &_offset)) {
+      continue;
+    }
+    const char* _args = _line + _offset;
+    bool _ok = true;
+
+    if (0 == strcmp(_command, "carriage")) {
+      char  _type;
+      float _speed;
+      _ok = (2 == sscanf(_args, "%c %f", &_type, &_speed));
+      if (_ok && NULL == s_carriage) {
+        s_carriage = new VirtualCarriage(('L' == _type) ? L : K,
+                                         END_LEFT + 16);
+      }
+      if (_ok) {
+        s_carriage->setSpeed(_speed, 0);
+      }
+    } else if (0 == strcmp(_command, "move")) {
+      int _position;
+      _ok = (1 == sscanf(_args, "%d", &_position)) && NULL != s_carriage;
+      if (_ok) {
+        s_carriage->moveTo(_position);
+        _ok = run(&isStopped, 60000000ULL);
+      }
+    } else if (0 == strcmp(_command, "wait")) {
+      unsigned long _us;
+      _ok = (1 == sscanf(_args, "%lu", &_us)) && run(NULL, _us);
+    } else if (0 == strcmp(_command, "send")) {
+      uint8_t  payload[64];
+      size_t   _size = 0;
+      unsigned _byte;
+      int      _read;
+      while (_size < sizeof(payload)
+             && 1 == sscanf(_args, "%x%n", &_byte, &_read)) {
+        payload[_size++] = _byte;
+        _args += _read;
+      }
+      send(payload, _size);
+    } else if (0 == strcmp(_command, "waitfor")) {
+      unsigned long _us = 1000000;
+      _ok = (1 <= sscanf(_args, "%x %lu", &s_waitId, &_us))
+            && run(&isReceived, _us);
+      memset(s_seen, 0, sizeof(s_seen));
+    } else if (0 == strcmp(_command, "lines")) {
+      s_lineLatency = 0;
+      _ok = (1 <= sscanf(_args, "%d %u", &s_lines, &s_lineLatency));
+    } else {
+      _ok = false;
+    }
+
+    if (!_ok) {
+      fprintf(stderr, "scenario line %d failed: %s", _number, _line);
+      return false;
+    }
+  }
+  return true;
+}
+
+
+static void report(FILE* out, const char* elf, const char* scenario) {
+  fprintf(out, "{\n");
+  fprintf(out, "  \"elf\": \"%s\",\n", elf);
+  fprintf(out, "  \"scenario\": \"%s\",\n", scenario);
+  fprintf(out, "  \"frequency\": %d,\n", BENCH_FREQUENCY);
+  fprintf(out, "  \"cycles\": %llu,\n", (unsigned long long)s_avr->cycle);
+  // Static RAM, the stack and the heap share what is left of the 2kB
+  fprintf(out, "  \"size\": {\"text\": %u, \"data\": %u, \"bss\": %u, "
+          "\"flash\": %u, \"ram\": %u},\n", s_size.text, s_size.data,
+          s_size.bss, s_size.text + s_size.data, s_size.data + s_size.bss);
+  fprintf(out, "  \"functions\": {\n");
+  for (size_t i = 0; i < MEASURED_COUNT; i++) {
+    Measured_t* _measured = &s_measured[i];
+    fprintf(out, "    \"%s\": ", _measured->label);
+    if (0 == _measured->calls) {
+      fprintf(out, "null");
+    } else {
+      fprintf(out, "{\"calls\": %u, \"min\": %llu, \"avg\": %llu, "
+              "\"max\": %llu}", _measured->calls,
+              (unsigned long long)_measured->min,
+              (unsigned long long)(_measured->total / _measured->calls),
+              (unsigned long long)_measured->max);
+    }
+    fprintf(out, "%s\n", (i + 1 < MEASURED_COUNT) ? "," : "");
+  }
+  fprintf(out, "  },\n");
+  fprintf(out, "  \"edge_to_i2c\": ");
+  if (0 == s_edgeLatency.count) {
+    fprintf(out, "null\n");
+  } else {
+    fprintf(out, "{\"edges\": %u, \"min\": %llu, \"avg\": %llu, "
+            "\"max\": %llu, \"max_us\": %.1f}\n", s_edgeLatency.count,
+            (unsigned long long)s_edgeLatency.min,
+            (unsigned long long)(s_edgeLatency.total / s_edgeLatency.count),
+            (unsigned long long)s_edgeLatency.max,
+            s_edgeLatency.max * 1e6 / BENCH_FREQUENCY);
+  }
+  fprintf(out, "}\n");
+}
+
+
+int main(int argc, char** argv) {
+  FILE* _out = stdout;
+  int   _option;
+  while ((_option = getopt(argc, argv, "o:")) != -1) {
+    if ('o' != _option) {
+      return 1;
+    }
+    _out = fopen(optarg, "w");
+    if (NULL == _out) {
+      perror(optarg);
+      return 1;
+    }
+  }
+  if (argc - optind != 2) {
+    fprintf(stderr, "usage: %s [-o results.json] ayab.elf scenario\n",
+            argv[0]);
+    return 1;
+  }
+  const char* _elf          = argv[optind];
+  const char* _scenarioName = argv[optind + 1];
+
+  for (size_t i = 0; i < MEASURED_COUNT; i++) {
+    s_measured[i].min = (avr_cycle_count_t)-1;
+  }
+  if (!findSymbols(_elf)) {
+    fprintf(stderr, "no symbols from avr-nm\n");
+    return 1;
+  }
+  for (size_t i = 0; i < MEASURED_COUNT; i++) {
+    if (0 == s_measured[i].entry) {
+      fprintf(stderr, "no symbol for %s\n", s_measured[i].pattern);
+    }
+  }
+  if (!findSize(_elf)) {
+    fprintf(stderr, "no section sizes from avr-size\n");
+    return 1;
+  }
+
+  elf_firmware_t _firmware;
+  memset(&_firmware, 0, sizeof(_firmware));
+  if (0 != elf_read_firmware(_elf, &_firmware)) {
+    fprintf(stderr, "cannot read %s\n", _elf);
+    return 1;
+  }
+  s_avr = avr_make_mcu_by_name("atmega328p");
+  avr_init(s_avr);
+  s_avr->frequency = BENCH_FREQUENCY;
+  s_avr->vcc = s_avr->avcc = s_avr->aref = BENCH_VCC;
+  avr_load_firmware(s_avr, &_firmware);
+
+  // Keep the UART off stdout, watch it and the I2C bus instead
+  uint32_t _flags = 0;
+  avr_ioctl(s_avr, AVR_IOCTL_UART_GET_FLAGS('0'), &_flags);
+  _flags &= ~AVR_UART_FLAG_STDIO;
+  avr_ioctl(s_avr, AVR_IOCTL_UART_SET_FLAGS('0'), &_flags);
+  avr_irq_register_notify(avr_io_getirq(s_avr, AVR_IOCTL_UART_GETIRQ('0'),
+                                        UART_IRQ_OUTPUT), uartOutput, NULL);
+  avr_irq_register_notify(avr_io_getirq(s_avr, AVR_IOCTL_TWI_GETIRQ(0),
+                                        TWI_IRQ_OUTPUT), twiMessage, NULL);
+
+  // Idle machine: hall sensors see no carriage
+  for (byte pin = A0; pin < A0 + 8; pin++) {
+    hal_setAnalog(pin, 512);
+  }
+
+  FILE* _scenario = fopen(_scenarioName, "r");
+  if (NULL == _scenario) {
+    perror(_scenarioName);
+    return 1;
+  }
+  bool _ok = play(_scenario);
+  fclose(_scenario);
+
+  report(_out, _elf, _scenarioName);
+  return _ok ? 0 : 2;
+}
@@ -0,0 +1,103 @@
+#!/usr/bin/env python
+# compare.py
+#
+# This file is part of AYAB.
+#
+#    AYAB is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    AYAB is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+#
+#    Copyright 2013-2015 Christian Obersteiner, Andreas Mueller
+#    http://ayab-knitting.com
+
+"""Compare two results of avrbench or ayab-bench, flag slower functions.
+
+    compare.py old.json new.json [--threshold 5]
+
+Exits with 1 if the average or maximum cycles of a function, the
+maximum edge to I2C latency or the static RAM of the image grew by more
+than threshold percent.
+"""
+
+import argparse
+import json
+import sys
+
+
+def rows(results):
+    """(name, statistics) of the functions and the edge latency."""
+    entries = sorted(results["functions"].items())
+    if "edge_to_i2c" in results:
+        entries.append(("edge to I2C", results["edge_to_i2c"]))
+    return entries
+
+
+def change(old, new):
+    """Relative change in percent, None if either side is missing."""
+    if old is None or new is None or old == 0:
+        return None
+    return 100.0 * (new - old) / old
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("old")
+    parser.add_argument("new")
+    parser.add_argument("--threshold", type=float, default=5.0,
+                        help="percent of growth that counts as regression")
+    options = parser.parse_args()
+
+    with open(options.old) as f:
+        old_results = json.load(f)
+        old = dict(rows(old_results))
+    with open(options.new) as f:
+        results = json.load(f)
+        new = rows(results)
+
+    regressed = False
+    print("%-48s %10s %10s %8s %10s %10s %8s"
+          % (results.get("unit", "cycles"), "avg old", "new", "", "max old", "new", ""))
+    for name, stats in new:
+        before = old.get(name) or {}
+        stats = stats or {}
+        line = "%-48s" % name
+        for key in ("avg", "max"):
+            delta = change(before.get(key), stats.get(key))
+            line += " %10s %10s %8s" % (
+                before.get(key, "-"), stats.get(key, "-"),
+                "" if delta is None else "%+.1f%%" % delta)
+            if delta is not None and delta > options.threshold \
+                    and (key == "max" or name != "edge to I2C"):
+                regressed = True
+                line += " !"
+        print(line)
+
+    # Section sizes of the AVR image, bytes
+    old_size = old_results.get("size") or {}
+    new_size = results.get("size") or {}
+    for key in ("flash", "ram"):
+        if key not in new_size:
+            continue
+        delta = change(old_size.get(key), new_size.get(key))
+        line = "%-48s %10s %10s %8s" % (
+            "%s (bytes)" % key, old_size.get(key, "-"), new_size[key],
+            "" if delta is None else "%+.1f%%" % delta)
+        if key == "ram" and delta is not None \
+                and delta > options.threshold:
+            regressed = True
+            line += " !"
+        print(line)
+    return 1 if regressed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,127 @@
+// colourline.cpp
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#include "Arduino.h"
+#include "./colourline.h"
+
+
+ColourLine::ColourLine() {
+  m_colours = 2;
+  m_bits    = 2;
+  m_mode    = ColourClassic;
+  m_passes  = 2;
+  m_configured = false;
+  reset();
+}
+
+
+bool ColourLine::configure(const uint8_t* data, size_t size) {
+  if (size < 2
+      || data[0] < 2 || data[0] > COLOURS_MAX
+      || data[1] > ColourMiddleTwice) {
+    return false;
+  }
+
+  m_colours = data[0];
+  m_bits    = (m_colours <= 4) ? 2 : 4;
+  m_mode    = (ColourMode_t)data[1];
+  if (ColourMiddleTwice == m_mode) {
+    m_passes = 2 * (m_colours - 1);
+  } else {
+    m_passes = m_colours;
+  }
+  m_configured = true;
+
+  reset();
+  return true;
+}
+
+
+bool ColourLine::isConfigured() {
+  return m_configured;
+}
+
+
+void ColourLine::reset() {
+  // Nothing loaded yet, the first line is not reversed
+  m_pass     = m_passes;
+  m_reversed = true;
+}
+
+
+bool ColourLine::load(const uint8_t* data, size_t size) {
+  if (size != (size_t)NUM_NEEDLES * m_bits / 8) {
+    return false;
+  }
+
+  memcpy(m_data, data, size);
+  m_pass     = 0;
+  m_reversed = (ColourBirdseye == m_mode) && !m_reversed;
+  return true;
+}
+
+
+bool ColourLine::hasPass() {
+  return m_pass < m_passes;
+}
+
+
+bool ColourLine::nextPass(byte startNeedle, byte stopNeedle, byte* line) {
+  byte _colour = passColour(m_pass);
+
+  memset(line, 0xFF, LINEBUFFER_LEN);
+  for (int needle = startNeedle; needle <= stopNeedle; needle++) {
+    if (_colour == getColour(needle)) {
+      // Inverted because of needle states
+      bitClear(line[needle / 8], needle % 8);
+    }
+  }
+
+  m_pass++;
+  return !hasPass();
+}
+
+
+/*
+ * PRIVATE METHODS
+ */
+byte ColourLine::passColour(byte pass) {
+  switch (m_mode) {
+    case ColourBirdseye:
+      return m_reversed ? m_colours - 1 - pass : pass;
+
+    case ColourMiddleTwice:
+      // 0, 1, 1, 2, 2, ..., n-1
+      return (pass + 1) / 2;
+
+    default:
+      return pass;
+  }
+}
+
+
+byte ColourLine::getColour(byte needle) {
+  if (2 == m_bits) {
+    return (m_data[needle / 4] >> ((needle % 4) * 2)) & 0x03;
+  } else {
+    return (m_data[needle / 2] >> ((needle % 2) * 4)) & 0x0F;
+  }
+}
@@ -0,0 +1,72 @@
+// colourline.h
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#ifndef COLOURLINE_H_
+#define COLOURLINE_H_
+
+#include "Arduino.h"
+#include "./settings.h"
+
+// Up to 4 colours fit in 2 bits per needle, more take 4 bits
+#define COLOURLINE_MAX_BYTES (NUM_NEEDLES / 2)
+
+/*!
+ *  Colour indexed line and the single colour passes derived from it
+ *
+ *  Parameters as sent with reqStart: number of colours, ColourMode_t.
+ *  The colour of needle n is stored LSB first, i.e. at bits
+ *  (n%4)*2 of byte n/4 for 2 bits per needle and (n%2)*4 of byte n/2
+ *  for 4 bits per needle.
+ */
+class ColourLine {
+ public:
+  ColourLine();
+
+  bool configure(const uint8_t* data, size_t size);
+  /*! Parameters were sent since start */
+  bool isConfigured();
+  /*! Start over before the first line */
+  void reset();
+
+  bool load(const uint8_t* data, size_t size);
+  /*! Passes of the loaded line not derived yet */
+  bool hasPass();
+  /*! Bitmap of the next pass in needle state order,
+   *  returns true for the last pass of the line
+   */
+  bool nextPass(byte startNeedle, byte stopNeedle, byte* line);
+
+ private:
+  byte         m_data[COLOURLINE_MAX_BYTES];
+  byte         m_colours;
+  byte         m_bits;
+  ColourMode_t m_mode;
+  bool         m_configured;
+
+  byte         m_passes;
+  byte         m_pass;
+  bool         m_reversed;
+
+  byte passColour(byte pass);
+  byte getColour(byte needle);
+};
+
+#endif  // COLOURLINE_H_
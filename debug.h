@@ -22,26 +22,58 @@ This file is part of AYAB.
 #ifndef DEBUG_H_
 #define DEBUG_H_
 
+#include "./logger.h"
 
-// #define DEBUG
+// #define NO_LOG  // Turn on to leave out all log calls
 
 /*
- *
+ * Log messages as name, number of arguments and text, the text only
+ * exists on the host.
+ * Tokens are numbered in order of this table, so append new messages
+ * at the end. tools/decode_log.py reads the table from this file.
  */
-#ifdef DEBUG
-  #define DEBUG_PRINT(str) \
-    Serial.print("#"); \
-    Serial.print(millis()); \
-    Serial.print(": "); \
-    Serial.print(__FUNCTION__); \
-    Serial.print("() in "); \
-    Serial.print(__FILE__); \
-    Serial.print(':'); \
-    Serial.print(__LINE__); \
-    Serial.print(' '); \
-    Serial.println(str);
+#define LOG_TOKENS(X) \
+  X(LogStateChanged,    2, "state %u -> %u") \
+  X(LogLineRequested,   2, "line %u requested, %u free") \
+  X(LogLineAccepted,    1, "line %u accepted") \
+  X(LogLineRejected,    2, "line %u rejected, expected %u") \
+  X(LogLineDone,        1, "line done, %u knitted") \
+  X(LogEndWork,         1, "end of work after %u lines") \
+  X(LogJobStarted,      2, "job started, needles %u to %u") \
+  X(LogPatternStored,   1, "pattern stored, %u bytes") \
+  X(LogPatternRejected, 1, "pattern rejected at offset %u")
+
+#define LOG_TOKEN_ID(token, argc, text) token,
+typedef enum LogToken {
+  LOG_TOKENS(LOG_TOKEN_ID)
+  LogTokenCount
+} LogToken_t;
+#undef LOG_TOKEN_ID
+
+// Number of arguments of each token, as <token>Args
+#define LOG_TOKEN_ARGS(token, argc, text) token##Args = argc,
+enum LogTokenArgs {
+  LOG_TOKENS(LOG_TOKEN_ARGS)
+};
+#undef LOG_TOKEN_ARGS
+
+// Fails to compile with an array of size -1, as there is no
+// static_assert in the C++98 of the AVR toolchain
+#define LOG_CHECK(token, argc) \
+  typedef char token##_takes_##argc##_arguments \
+    [(token##Args == argc) ? 1 : -1] __attribute__((unused))
+
+#ifndef NO_LOG
+  #define LOG0(token) \
+    do { LOG_CHECK(token, 0); logger.log(token, 0, 0, 0); } while (0)
+  #define LOG1(token, a) \
+    do { LOG_CHECK(token, 1); logger.log(token, 1, (a), 0); } while (0)
+  #define LOG2(token, a, b) \
+    do { LOG_CHECK(token, 2); logger.log(token, 2, (a), (b)); } while (0)
 #else
-  #define DEBUG_PRINT(str)
+  #define LOG0(token)       do { LOG_CHECK(token, 0); } while (0)
+  #define LOG1(token, a)    do { LOG_CHECK(token, 1); } while (0)
+  #define LOG2(token, a, b) do { LOG_CHECK(token, 2); } while (0)
 #endif
 
 #endif  // DEBUG_H_
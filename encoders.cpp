@@ -29,6 +29,8 @@ Encoders::Encoders() {
   m_beltShift    = Unknown;
   m_carriage     = NoCarriage;
   m_encoderPos   = 0x00;
+  m_hallValueL   = 0;
+  m_hallValueR   = 0;
 }
 
 
@@ -78,7 +80,7 @@ void Encoders::encA_rising() {
     }
 
     // Belt shift signal only decided in front of hall sensor
-    m_beltShift = digitalRead(ENC_PIN_C) ? Regular : Shifted;
+    setBeltshift(digitalRead(ENC_PIN_C));
 
     // Known position of the carriage -> overwrite position
     m_encoderPos = END_LEFT + 28;
@@ -105,13 +107,22 @@ void Encoders::encA_falling() {
     }
 
     // Belt shift signal only decided in front of hall sensor
-    m_beltShift = digitalRead(ENC_PIN_C) ? Shifted : Regular;
+    setBeltshift(!digitalRead(ENC_PIN_C));
 
     // Known position of the carriage -> overwrite position
     m_encoderPos = END_RIGHT - 28;
   }
 }
 
+void Encoders::setBeltshift(bool regular) {
+  // The lace carriage gets its own belt shift states
+  if (L == m_carriage) {
+    m_beltShift = regular ? Lace_Regular : Lace_Shifted;
+  } else {
+    m_beltShift = regular ? Regular : Shifted;
+  }
+}
+
 byte Encoders::getPosition() {
   return m_encoderPos;
 }
@@ -135,10 +146,24 @@ Carriage_t Encoders::getCarriage() {
 uint16 Encoders::getHallValue(Direction_t pSensor) {
   switch (pSensor) {
     case Left:
-      return analogRead(EOL_PIN_L);
+      return m_hallValueL;
     case Right:
-      return analogRead(EOL_PIN_R);
+      return m_hallValueR;
     default:
       return 0;
   }
 }
+
+void Encoders::updateHallValues() {
+  // The ADC is used by the encoder ISR as well
+  uint16 _value;
+  noInterrupts();
+  _value = analogRead(EOL_PIN_L);
+  interrupts();
+  m_hallValueL = _value;
+
+  noInterrupts();
+  _value = analogRead(EOL_PIN_R);
+  interrupts();
+  m_hallValueR = _value;
+}
@@ -37,7 +37,9 @@ class Encoders{
   Direction_t   getHallActive();
   Carriage_t    getCarriage();
 
+  /*! Hall sensor value as of the last updateHallValues() */
   uint16 getHallValue(Direction_t);
+  void   updateHallValues();
 
  private:
   Direction_t   m_direction;
@@ -45,9 +47,12 @@ class Encoders{
   Beltshift_t   m_beltShift;
   Carriage_t    m_carriage;
   byte          m_encoderPos;
+  uint16        m_hallValueL;
+  uint16        m_hallValueR;
 
   void encA_rising();
   void encA_falling();
+  void setBeltshift(bool regular);
 };
 
 #endif  // ENCODERS_H_
@@ -0,0 +1,52 @@
+// histogram.cpp
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#include "Arduino.h"
+#include "./histogram.h"
+
+Histogram latencies[LatencyCount];
+
+
+Histogram::Histogram() {
+  reset();
+}
+
+
+void Histogram::add(unsigned long duration) {
+  byte _bucket = 0;
+  while (duration > 1 && _bucket < HISTOGRAM_BUCKETS - 1) {
+    duration >>= 1;
+    _bucket++;
+  }
+  if (m_counts[_bucket] < 0xFFFF) {
+    m_counts[_bucket]++;
+  }
+}
+
+
+uint16 Histogram::getCount(byte bucket) {
+  return m_counts[bucket];
+}
+
+
+void Histogram::reset() {
+  memset(m_counts, 0, sizeof(m_counts));
+}
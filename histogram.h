@@ -0,0 +1,50 @@
+// histogram.h
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include "Arduino.h"
+#include "./settings.h"
+
+/*!
+ *  Histogram of durations in log2 buckets
+ *
+ *  Bucket 0 counts durations below 2us, bucket n those from 2^n us
+ *  to below 2^(n+1) us, the last bucket everything above. Counts
+ *  saturate instead of wrapping around.
+ */
+class Histogram {
+ public:
+  Histogram();
+
+  void   add(unsigned long duration);
+  uint16 getCount(byte bucket);
+  void   reset();
+
+ private:
+  uint16 m_counts[HISTOGRAM_BUCKETS];
+};
+
+// Durations measured throughout the firmware
+extern Histogram latencies[LatencyCount];
+
+#endif  // HISTOGRAM_H_
@@ -0,0 +1,44 @@
+// EEPROM.h
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#ifndef HOST_EEPROM_H_
+#define HOST_EEPROM_H_
+
+#include "./Arduino.h"
+
+/*!
+ *  EEPROM of the host build, erased at start,
+ *  with the interface of the Arduino 1.0.6 EEPROM library
+ */
+class EEPROMClass {
+ public:
+  EEPROMClass();
+
+  uint8_t read(int address);
+  void    write(int address, uint8_t value);
+
+ private:
+  uint8_t m_data[E2END + 1];
+};
+
+extern EEPROMClass EEPROM;
+
+#endif  // HOST_EEPROM_H_
@@ -0,0 +1,38 @@
+// SPI.h
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#ifndef HOST_SPI_H_
+#define HOST_SPI_H_
+
+#include "./Arduino.h"
+
+/*!
+ *  SPI of the host build, no device is attached
+ */
+class SPIClass {
+ public:
+  void    begin() {}
+  uint8_t transfer(uint8_t) { return 0xFF; }
+};
+
+extern SPIClass SPI;
+
+#endif  // HOST_SPI_H_
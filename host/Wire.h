@@ -0,0 +1,53 @@
+// Wire.h
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#ifndef HOST_WIRE_H_
+#define HOST_WIRE_H_
+
+#include "./Arduino.h"
+
+#define BUFFER_LENGTH 32
+
+/*!
+ *  I2C master of the host build, talks to the register files of hal.cpp
+ */
+class TwoWire {
+ public:
+  void begin();
+
+  void    beginTransmission(uint8_t address);
+  size_t  write(uint8_t value);
+  uint8_t endTransmission(bool stop = true);
+
+  uint8_t requestFrom(uint8_t address, uint8_t quantity);
+  int     available();
+  int     read();
+
+ private:
+  uint8_t m_address;
+  uint8_t m_buffer[BUFFER_LENGTH];
+  uint8_t m_size;
+  uint8_t m_index;
+};
+
+extern TwoWire Wire;
+
+#endif  // HOST_WIRE_H_
@@ -0,0 +1,375 @@
+// bench.cpp
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+/*
+ * Microbenchmarks of the firmware's hot path kernels on the PC
+ *
+ *   ayab-bench [-f filter] [-r repetitions] [-t ms] [-o results.json]
+ *
+ * Each kernel runs in a loop long enough to take -t ms (10), that is
+ * repeated -r times (15). Times are ns per call on this machine, so only
+ * compare results from the same machine and build: save one run before
+ * and one after a change, then
+ *
+ *   python bench/compare.py before.json after.json
+ *
+ * -f runs only the kernels whose name contains filter.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "./Arduino.h"
+#include "./knitter.h"
+#include "./linecodec.h"
+#include "./Encoding/SLIP.h"
+#include "./Encoding/COBS.h"
+
+#define BENCH_PAYLOAD_LEN (LINEBUFFER_LEN + 4)  // cnfLine
+
+// Keeps the compiler from hoisting a kernel out of the loop
+#define BENCH_CLOBBER() __asm__ __volatile__("" : : : "memory")
+
+/*! Reaches the private kernels of Knitter, a friend in the host build */
+class KnitterBench {
+ public:
+  static uint32_t calculatePixelAndSolenoid(Knitter* knitter,
+                                            uint32_t iterations) {
+    uint32_t _sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+      // Every encoder position once
+      for (int position = 0; position < 256; position++) {
+        knitter->m_position = position;
+        if (knitter->calculatePixelAndSolenoid()) {
+          _sum += knitter->m_pixelToSet + knitter->m_solenoidToSet;
+        }
+        BENCH_CLOBBER();
+      }
+    }
+    return _sum;
+  }
+
+  static uint32_t getPixelValue(Knitter* knitter, uint32_t iterations) {
+    const Line_t* _line = knitter->m_lines.getCurrent();
+    uint32_t      _sum  = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+      for (int pixel = 0; pixel < NUM_NEEDLES; pixel++) {
+        _sum += knitter->getPixelValue(_line, pixel, knitter->m_direction);
+        BENCH_CLOBBER();
+      }
+    }
+    return _sum;
+  }
+
+  static void setMachine(Knitter* knitter, Carriage_t carriage,
+                         Direction_t direction, Beltshift_t beltshift) {
+    knitter->m_carriage  = carriage;
+    knitter->m_direction = direction;
+    knitter->m_beltshift = beltshift;
+  }
+
+  static void setLines(Knitter* knitter, LineSource_t source,
+                       const byte* line, const byte* lace) {
+    knitter->m_lineSource = source;
+    knitter->m_lines.reset(0, NUM_NEEDLES - 1);
+    knitter->m_lines.push(line);
+    knitter->m_lines.advance();
+    knitter->m_laceLine.load(lace, LACELINE_BYTES);
+  }
+};
+
+typedef struct Benchmark {
+  std::string name;
+  uint32_t  (*kernel)(const struct Benchmark*, uint32_t iterations);
+  uint32_t    calls;  // kernel calls per iteration
+  int         param[3];
+} Benchmark_t;
+
+typedef struct Statistics {
+  double min;
+  double median;
+  double mean;
+  double max;
+} Statistics_t;
+
+static Knitter* s_knitter;
+static uint8_t  s_payload[BENCH_PAYLOAD_LEN];
+static uint8_t  s_slip[2 * BENCH_PAYLOAD_LEN];
+static size_t   s_slipSize;
+static uint8_t  s_cobs[BENCH_PAYLOAD_LEN + 2];
+static size_t   s_cobsSize;
+
+static volatile uint32_t s_sink;
+
+
+/*
+ * Kernels
+ */
+static uint32_t benchCalculate(const Benchmark_t* benchmark,
+                               uint32_t iterations) {
+  KnitterBench::setMachine(s_knitter, (Carriage_t)benchmark->param[0],
+                           (Direction_t)benchmark->param[1],
+                           (Beltshift_t)benchmark->param[2]);
+  return KnitterBench::calculatePixelAndSolenoid(s_knitter, iterations);
+}
+
+static uint32_t benchPixel(const Benchmark_t* benchmark,
+                           uint32_t iterations) {
+  KnitterBench::setMachine(s_knitter,
+                           (SourceLace == benchmark->param[0]) ? L : K,
+                           (Direction_t)benchmark->param[1], Regular);
+  KnitterBench::setLines(s_knitter, (LineSource_t)benchmark->param[0],
+                         &s_payload[2], &s_payload[2]);
+  return KnitterBench::getPixelValue(s_knitter, iterations);
+}
+
+static uint32_t benchSlipEncode(const Benchmark_t*, uint32_t iterations) {
+  uint32_t _sum = 0;
+  for (uint32_t i = 0; i < iterations; i++) {
+    _sum += SLIP::encode(s_payload, sizeof(s_payload), s_slip);
+    BENCH_CLOBBER();
+  }
+  return _sum;
+}
+
+static uint32_t benchSlipDecode(const Benchmark_t*, uint32_t iterations) {
+  uint8_t  _decoded[BENCH_PAYLOAD_LEN];
+  uint32_t _sum = 0;
+  for (uint32_t i = 0; i < iterations; i++) {
+    _sum += SLIP::decode(s_slip, s_slipSize, _decoded);
+    BENCH_CLOBBER();
+  }
+  return _sum;
+}
+
+static uint32_t benchCobsEncode(const Benchmark_t*, uint32_t iterations) {
+  uint32_t _sum = 0;
+  for (uint32_t i = 0; i < iterations; i++) {
+    _sum += COBS::encode(s_payload, sizeof(s_payload), s_cobs);
+    BENCH_CLOBBER();
+  }
+  return _sum;
+}
+
+static uint32_t benchCobsDecode(const Benchmark_t*, uint32_t iterations) {
+  uint8_t  _decoded[BENCH_PAYLOAD_LEN];
+  uint32_t _sum = 0;
+  for (uint32_t i = 0; i < iterations; i++) {
+    _sum += COBS::decode(s_cobs, s_cobsSize, _decoded);
+    BENCH_CLOBBER();
+  }
+  return _sum;
+}
+
+static uint32_t benchInvert(const Benchmark_t*, uint32_t iterations) {
+  // Line data of h_cnfLine() into needle states
+  byte     _line[LINEBUFFER_LEN];
+  uint32_t _sum = 0;
+  for (uint32_t i = 0; i < iterations; i++) {
+    _sum += LineCodec::decodeRaw(&s_payload[2], LINEBUFFER_LEN, _line);
+    BENCH_CLOBBER();
+  }
+  return _sum + _line[0];
+}
+
+
+static std::vector<Benchmark_t> benchmarks() {
+  static const char* const _carriages[]  = {"K", "L", "G"};
+  static const char* const _directions[] = {"Left", "Right"};
+  static const char* const _beltshifts[] = {"Regular", "Shifted",
+                                            "Lace_Regular", "Lace_Shifted"};
+  std::vector<Benchmark_t> _list;
+  Benchmark_t              _benchmark;
+
+  _benchmark.kernel = &benchCalculate;
+  _benchmark.calls  = 256;
+  for (int carriage = K; carriage <= G; carriage++) {
+    for (int direction = Left; direction <= Right; direction++) {
+      for (int beltshift = Regular; beltshift <= Lace_Shifted; beltshift++) {
+        _benchmark.name = std::string("calculatePixelAndSolenoid ")
+                          + _carriages[carriage - K] + " "
+                          + _directions[direction - Left] + " "
+                          + _beltshifts[beltshift - Regular];
+        _benchmark.param[0] = carriage;
+        _benchmark.param[1] = direction;
+        _benchmark.param[2] = beltshift;
+        _list.push_back(_benchmark);
+      }
+    }
+  }
+
+  _benchmark.kernel = &benchPixel;
+  _benchmark.calls  = NUM_NEEDLES;
+  for (int direction = Left; direction <= Right; direction++) {
+    _benchmark.name = std::string("getPixelValue line ")
+                      + _directions[direction - Left];
+    _benchmark.param[0] = SourceHost;
+    _benchmark.param[1] = direction;
+    _list.push_back(_benchmark);
+    _benchmark.name = std::string("getPixelValue lace ")
+                      + _directions[direction - Left];
+    _benchmark.param[0] = SourceLace;
+    _list.push_back(_benchmark);
+  }
+
+  _benchmark.calls = 1;
+  _benchmark.name = "SLIP::encode cnfLine";
+  _benchmark.kernel = &benchSlipEncode;
+  _list.push_back(_benchmark);
+  _benchmark.name = "SLIP::decode cnfLine";
+  _benchmark.kernel = &benchSlipDecode;
+  _list.push_back(_benchmark);
+  _benchmark.name = "COBS::encode cnfLine";
+  _benchmark.kernel = &benchCobsEncode;
+  _list.push_back(_benchmark);
+  _benchmark.name = "COBS::decode cnfLine";
+  _benchmark.kernel = &benchCobsDecode;
+  _list.push_back(_benchmark);
+  _benchmark.name = "LineCodec::decodeRaw (h_cnfLine)";
+  _benchmark.kernel = &benchInvert;
+  _list.push_back(_benchmark);
+  return _list;
+}
+
+
+/*
+ * Harness
+ */
+static double now() {
+  struct timespec _time;
+  clock_gettime(CLOCK_MONOTONIC, &_time);
+  return _time.tv_sec + _time.tv_nsec * 1e-9;
+}
+
+/*! Seconds for the given number of iterations */
+static double measure(const Benchmark_t* benchmark, uint32_t iterations) {
+  double _start = now();
+  s_sink = benchmark->kernel(benchmark, iterations);
+  return now() - _start;
+}
+
+static Statistics_t run(const Benchmark_t* benchmark, int repetitions,
+                        double duration) {
+  // Grow the loop until it takes long enough to time
+  uint32_t _iterations = 1;
+  while (measure(benchmark, _iterations) < duration
+         && _iterations < (1UL << 30)) {
+    _iterations *= 2;
+  }
+
+  std::vector<double> _times;
+  for (int i = 0; i < repetitions; i++) {
+    double _seconds = measure(benchmark, _iterations);
+    _times.push_back(_seconds * 1e9 / _iterations / benchmark->calls);
+  }
+  std::sort(_times.begin(), _times.end());
+
+  Statistics_t _statistics;
+  _statistics.min    = _times.front();
+  _statistics.max    = _times.back();
+  _statistics.median = _times[_times.size() / 2];
+  _statistics.mean   = 0;
+  for (size_t i = 0; i < _times.size(); i++) {
+    _statistics.mean += _times[i] / _times.size();
+  }
+  return _statistics;
+}
+
+
+int main(int argc, char** argv) {
+  const char* _filter      = "";
+  int         _repetitions = 15;
+  double      _duration    = 0.010;
+  FILE*       _out         = NULL;
+
+  int _option;
+  while ((_option = getopt(argc, argv, "f:r:t:o:")) != -1) {
+    switch (_option) {
+      case 'f':
+        _filter = optarg;
+        break;
+      case 'r':
+        _repetitions = max(1, atoi(optarg));
+        break;
+      case 't':
+        _duration = atof(optarg) / 1000;
+        break;
+      case 'o':
+        _out = fopen(optarg, "w");
+        if (NULL == _out) {
+          perror(optarg);
+          return 1;
+        }
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-f filter] [-r repetitions] [-t ms] "
+                "[-o results.json]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  // Same data for every run, a cnfLine with a random pattern
+  srand(1);
+  s_payload[0] = cnfLine_msgid;
+  for (size_t i = 1; i < sizeof(s_payload); i++) {
+    s_payload[i] = rand() & 0xFF;
+  }
+  s_slipSize = SLIP::encode(s_payload, sizeof(s_payload), s_slip);
+  s_cobsSize = COBS::encode(s_payload, sizeof(s_payload), s_cobs);
+  s_knitter  = new Knitter(NULL);
+
+  std::vector<Benchmark_t> _benchmarks = benchmarks();
+  printf("%-48s %9s %9s %9s %9s\n", "ns per call", "min", "median",
+         "mean", "max");
+  if (NULL != _out) {
+    fprintf(_out, "{\n  \"unit\": \"ns\",\n  \"functions\": {");
+  }
+  bool _first = true;
+  for (size_t i = 0; i < _benchmarks.size(); i++) {
+    const Benchmark_t* _benchmark = &_benchmarks[i];
+    if (std::string::npos == _benchmark->name.find(_filter)) {
+      continue;
+    }
+    Statistics_t _statistics = run(_benchmark, _repetitions, _duration);
+    printf("%-48s %9.2f %9.2f %9.2f %9.2f\n", _benchmark->name.c_str(),
+           _statistics.min, _statistics.median, _statistics.mean,
+           _statistics.max);
+    fflush(stdout);
+    if (NULL != _out) {
+      fprintf(_out, "%s\n    \"%s\": {\"min\": %.2f, \"median\": %.2f, "
+              "\"avg\": %.2f, \"max\": %.2f}", _first ? "" : ",",
+              _benchmark->name.c_str(), _statistics.min,
+              _statistics.median, _statistics.mean, _statistics.max);
+    }
+    _first = false;
+  }
+  if (NULL != _out) {
+    fprintf(_out, "\n  }\n}\n");
+    fclose(_out);
+  }
+  return 0;
+}
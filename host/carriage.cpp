@@ -0,0 +1,176 @@
+// carriage.cpp
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#include <math.h>
+
+#include "./carriage.h"
+
+VirtualCarriage* VirtualCarriage::s_moving = NULL;
+
+
+VirtualCarriage::VirtualCarriage(Carriage_t type, int position) {
+  m_type             = type;
+  m_speed            = 200;
+  m_acceleration     = 0;
+  m_beltPhase        = 8;
+  m_step             = position * 4;
+  m_target           = m_step;
+  m_velocity         = 0;
+  m_direction        = NoDirection;
+  m_encoderPos       = END_LEFT;
+  m_encoderDirection = NoDirection;
+  m_onPosition       = NULL;
+  setInputs();
+}
+
+
+void VirtualCarriage::setSpeed(float speed, float acceleration) {
+  m_speed        = speed;
+  m_acceleration = acceleration;
+}
+
+
+void VirtualCarriage::setBeltPhase(byte phase) {
+  m_beltPhase = phase % 16;
+}
+
+
+void VirtualCarriage::onPosition(void (*callback)(byte, Direction_t)) {
+  m_onPosition = callback;
+}
+
+
+void VirtualCarriage::moveTo(int position) {
+  m_target    = position * 4;
+  m_direction = (m_target > m_step) ? Right : Left;
+  m_velocity  = (m_acceleration > 0) ? CARRIAGE_MIN_SPEED : m_speed;
+  if (m_target != m_step) {
+    s_moving = this;
+    schedule();
+  }
+}
+
+
+bool VirtualCarriage::isMoving() {
+  return m_step != m_target;
+}
+
+
+float VirtualCarriage::getPosition() {
+  return m_step / 4.0;
+}
+
+
+Direction_t VirtualCarriage::getDirection() {
+  return m_direction;
+}
+
+
+/*
+ * PRIVATE METHODS
+ */
+void VirtualCarriage::stepEvent() {
+  s_moving->step();
+}
+
+
+void VirtualCarriage::schedule() {
+  // Speed up from the start, slow down towards the target
+  if (m_acceleration > 0) {
+    float _left = abs(m_target - m_step) / 4.0;
+    float _up   = sqrt(m_velocity * m_velocity + 0.5 * m_acceleration);
+    float _down = sqrt(2 * m_acceleration * _left);
+    m_velocity  = max(CARRIAGE_MIN_SPEED, min(m_speed, min(_up, _down)));
+  }
+  hal_schedule(hal_now() + (uint64_t)(1000000.0 / (4 * m_velocity)), &stepEvent);
+}
+
+
+void VirtualCarriage::step() {
+  bool _oldA = hal_getPin(ENC_PIN_A);
+  m_step += (Right == m_direction) ? 1 : -1;
+  setInputs();
+  bool _newA = hal_getPin(ENC_PIN_A);
+
+  // Count like Encoders does, to tell which needle is being set
+  byte _oldPos = m_encoderPos;
+  if (!_oldA && _newA) {
+    m_encoderDirection = hal_getPin(ENC_PIN_B) ? Right : Left;
+    if (Right == m_encoderDirection && m_encoderPos < END_RIGHT) {
+      m_encoderPos++;
+    }
+    int _hall = analogRead(EOL_PIN_L);
+    if (_hall < FILTER_L_MIN || _hall > FILTER_L_MAX) {
+      m_encoderPos = HALL_LEFT_POSITION;
+    }
+  } else if (_oldA && !_newA) {
+    if (Left == m_encoderDirection && m_encoderPos > END_LEFT) {
+      m_encoderPos--;
+    }
+    int _hall = analogRead(EOL_PIN_R);
+    if (_hall < FILTER_R_MIN || _hall > FILTER_R_MAX) {
+      m_encoderPos = HALL_RIGHT_POSITION;
+    }
+  }
+  if (_oldPos != m_encoderPos && NULL != m_onPosition) {
+    m_onPosition(_oldPos, m_encoderDirection);
+  }
+
+  if (isMoving()) {
+    schedule();
+  }
+}
+
+
+void VirtualCarriage::setInputs() {
+  // Inputs which are sampled on the edges of A change first
+  bool _leftActive  = abs(m_step - HALL_LEFT_POSITION * 4) <= 2;
+  bool _rightActive = abs(m_step - HALL_RIGHT_POSITION * 4) <= 2;
+  hal_setAnalog(EOL_PIN_L, getHallValue(Left, _leftActive));
+  hal_setAnalog(EOL_PIN_R, getHallValue(Right, _rightActive));
+
+  int _needle = (m_step >= 0) ? m_step / 4 : (m_step - 3) / 4;
+  hal_setPin(ENC_PIN_C, ((_needle + m_beltPhase) & 0x0F) < 8);
+
+  // Quadrature, B leads A when moving right
+  byte _phase = m_step & 0x03;
+  hal_setPin(ENC_PIN_B, 0 == _phase || 1 == _phase);
+  hal_setPin(ENC_PIN_A, 1 == _phase || 2 == _phase);
+}
+
+
+int VirtualCarriage::getHallValue(Direction_t sensor, bool active) {
+  // Percent of full scale, see carriage_hallvalues.md
+#ifdef KH910
+  static const byte _levels[2][3] = {
+    // -, K, L
+    {38, 73, 1},   // Left
+    {57, 0, 57}    // Right
+  };
+#else
+  static const byte _levels[2][3] = {
+    {43, 74, 0},
+    {35, 73, 0}
+  };
+#endif
+  byte _carriage = !active ? 0 : (L == m_type) ? 2 : 1;
+  return _levels[(Left == sensor) ? 0 : 1][_carriage] * 1023 / 100;
+}
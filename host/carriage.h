@@ -0,0 +1,91 @@
+// carriage.h
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#ifndef HOST_CARRIAGE_H_
+#define HOST_CARRIAGE_H_
+
+#include "./Arduino.h"
+#include "./settings.h"
+
+#define HALL_LEFT_POSITION  (END_LEFT + 28)   // encoder position at the sensor
+#define HALL_RIGHT_POSITION (END_RIGHT - 28)
+#define CARRIAGE_MIN_SPEED  10.0  // needles/s, start and stop of a stroke
+
+/*!
+ *  Carriage of a simulated KH910/KH930 on the bed
+ *
+ *  Positions are in needles, the unit of the encoder position of the
+ *  firmware. The carriage moves in quarter needle steps of the
+ *  ENC_PIN_A/B quadrature, ENC_PIN_C follows the belt, which has a
+ *  period of 16 needles. The hall sensors see the carriage's magnets
+ *  within half a needle of their position, at the levels of
+ *  carriage_hallvalues.md.
+ *
+ *  Steps are timed with hal_schedule(), so the encoder interrupt fires
+ *  at the simulated time the edge happens, even while the firmware
+ *  sleeps or waits in delay().
+ */
+class VirtualCarriage {
+ public:
+  VirtualCarriage(Carriage_t type, int position);
+
+  /*! Needles/s at full speed, needles/s^2 to get there (0: at once) */
+  void setSpeed(float speed, float acceleration);
+  /*! Belt position at the carriage, 8 gives Regular and 0 Shifted */
+  void setBeltPhase(byte phase);
+  /*! Called whenever the position counted like the firmware does changes,
+   *  with the position just left and the direction
+   */
+  void onPosition(void (*callback)(byte position, Direction_t direction));
+
+  /*! Travel to the given needle and stop there */
+  void moveTo(int position);
+  bool isMoving();
+
+  float       getPosition();
+  Direction_t getDirection();
+
+ private:
+  Carriage_t m_type;
+  float      m_speed;
+  float      m_acceleration;
+  byte       m_beltPhase;
+
+  int         m_step;      // quarter needles
+  int         m_target;    // quarter needles
+  float       m_velocity;  // needles/s
+  Direction_t m_direction;
+
+  // Position as counted by Encoders
+  byte        m_encoderPos;
+  Direction_t m_encoderDirection;
+  void      (*m_onPosition)(byte, Direction_t);
+
+  static VirtualCarriage* s_moving;
+  static void      stepEvent();
+
+  void step();
+  void schedule();
+  void setInputs();
+  int  getHallValue(Direction_t sensor, bool active);
+};
+
+#endif  // HOST_CARRIAGE_H_
@@ -0,0 +1,382 @@
+// hal.cpp
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#include <deque>
+
+#include "./Arduino.h"
+#include "./Wire.h"
+#include "./EEPROM.h"
+#include "./SPI.h"
+#include "./avr/sleep.h"
+
+HardwareSerial Serial;
+TwoWire        Wire;
+EEPROMClass    EEPROM;
+SPIClass       SPI;
+
+// Board state
+static uint64_t s_now = 0;
+static uint8_t  s_pins[HAL_PINS];
+static int      s_analog[8] = {512, 512, 512, 512, 512, 512, 512, 512};
+
+static bool     s_interruptsEnabled = true;
+static void   (*s_isr[2])() = {NULL, NULL};
+static int      s_isrMode[2];
+static bool     s_isrPending[2];
+
+static uint64_t s_eventAt = 0;
+static void   (*s_event)() = NULL;
+
+static uint8_t  s_i2cRegs[HAL_I2C_DEVICES][HAL_I2C_REGS];
+static uint8_t  s_i2cPointer[HAL_I2C_DEVICES];
+static void   (*s_i2cWrite)(uint8_t, uint8_t, uint8_t) = NULL;
+
+static std::deque<uint8_t> s_rx;
+static std::deque<uint8_t> s_tx;    // TX buffer of the UART
+static std::deque<uint8_t> s_sent;  // out of the UART, for the host
+static uint32_t s_serialRate = 11520;  // 115200 baud, 8N1
+static uint64_t s_txDone     = 0;      // us, current byte out of the UART
+
+
+/*
+ * Time
+ */
+static void moveTo(uint64_t time) {
+  // The UART keeps sending meanwhile
+  while (!s_tx.empty() && (0 == s_serialRate || s_txDone <= time)) {
+    s_sent.push_back(s_tx.front());
+    s_tx.pop_front();
+    if (!s_tx.empty() && s_serialRate) {
+      s_txDone += 1000000ULL / s_serialRate;
+    }
+  }
+  s_now = time;
+}
+
+static void fireEvent() {
+  void (*_event)() = s_event;
+  s_event = NULL;
+  moveTo(s_eventAt);
+  _event();
+}
+
+uint64_t hal_now() {
+  return s_now;
+}
+
+void hal_advance(uint64_t us) {
+  uint64_t _target = s_now + us;
+  while (NULL != s_event && s_eventAt <= _target) {
+    fireEvent();
+  }
+  moveTo(_target);
+}
+
+void hal_schedule(uint64_t at, void (*callback)()) {
+  s_eventAt = (at < s_now) ? s_now : at;
+  s_event   = callback;
+}
+
+unsigned long millis() {
+  return s_now / 1000;
+}
+
+unsigned long micros() {
+  return s_now;
+}
+
+void delay(unsigned long ms) {
+  hal_advance(ms * 1000ULL);
+}
+
+void delayMicroseconds(unsigned int us) {
+  hal_advance(us);
+}
+
+void set_sleep_mode(int) {}
+void sleep_enable() {}
+void sleep_disable() {}
+
+void sleep_cpu() {
+  // Woken by the next timer 0 overflow, or earlier by the simulation
+  uint64_t _tick = (s_now / HAL_TIMER_TICK + 1) * HAL_TIMER_TICK;
+  if (NULL != s_event && s_eventAt < _tick) {
+    fireEvent();
+  } else {
+    moveTo(_tick);
+  }
+}
+
+
+/*
+ * Pins and interrupts
+ */
+static void runIsr(byte interrupt) {
+  s_isrPending[interrupt] = false;
+  s_interruptsEnabled     = false;
+  s_isr[interrupt]();
+  s_interruptsEnabled     = true;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin < HAL_PINS && INPUT_PULLUP == mode) {
+    s_pins[pin] = HIGH;
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin < HAL_PINS) {
+    s_pins[pin] = value ? HIGH : LOW;
+  }
+}
+
+int digitalRead(uint8_t pin) {
+  return (pin < HAL_PINS) ? s_pins[pin] : LOW;
+}
+
+int analogRead(uint8_t pin) {
+  byte _channel = (pin >= A0) ? pin - A0 : pin;
+  return (_channel < 8) ? s_analog[_channel] : 0;
+}
+
+void analogWrite(uint8_t pin, int value) {
+  digitalWrite(pin, value > 127);
+}
+
+void attachInterrupt(uint8_t interrupt, void (*isr)(), int mode) {
+  if (interrupt < 2) {
+    s_isr[interrupt]        = isr;
+    s_isrMode[interrupt]    = mode;
+    s_isrPending[interrupt] = false;
+  }
+}
+
+void detachInterrupt(uint8_t interrupt) {
+  if (interrupt < 2) {
+    s_isr[interrupt] = NULL;
+  }
+}
+
+void noInterrupts() {
+  s_interruptsEnabled = false;
+}
+
+void interrupts() {
+  s_interruptsEnabled = true;
+  for (byte i = 0; i < 2; i++) {
+    if (s_isrPending[i] && NULL != s_isr[i]) {
+      runIsr(i);
+    }
+  }
+}
+
+void hal_setPin(uint8_t pin, uint8_t value) {
+  if (pin >= HAL_PINS) {
+    return;
+  }
+  uint8_t _old = s_pins[pin];
+  s_pins[pin]  = value ? HIGH : LOW;
+
+  // INT0 is on pin 2, INT1 on pin 3
+  if ((2 == pin || 3 == pin) && _old != s_pins[pin]) {
+    byte _interrupt = pin - 2;
+    int  _mode      = s_isrMode[_interrupt];
+    if (NULL != s_isr[_interrupt]
+        && (CHANGE == _mode
+            || (RISING == _mode && HIGH == s_pins[pin])
+            || (FALLING == _mode && LOW == s_pins[pin]))) {
+      s_isrPending[_interrupt] = true;
+      if (s_interruptsEnabled) {
+        runIsr(_interrupt);
+      }
+    }
+  }
+}
+
+uint8_t hal_getPin(uint8_t pin) {
+  return digitalRead(pin);
+}
+
+void hal_setAnalog(uint8_t pin, int value) {
+  byte _channel = (pin >= A0) ? pin - A0 : pin;
+  if (_channel < 8) {
+    s_analog[_channel] = value;
+  }
+}
+
+
+/*
+ * I2C
+ */
+uint8_t hal_i2cRegister(uint8_t address, uint8_t reg) {
+  return s_i2cRegs[address % HAL_I2C_DEVICES][reg % HAL_I2C_REGS];
+}
+
+void hal_onI2cWrite(void (*callback)(uint8_t, uint8_t, uint8_t)) {
+  s_i2cWrite = callback;
+}
+
+void TwoWire::begin() {
+  m_size  = 0;
+  m_index = 0;
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+  m_address = address % HAL_I2C_DEVICES;
+  m_size    = 0;
+}
+
+size_t TwoWire::write(uint8_t value) {
+  if (m_size >= BUFFER_LENGTH) {
+    return 0;
+  }
+  m_buffer[m_size++] = value;
+  return 1;
+}
+
+uint8_t TwoWire::endTransmission(bool) {
+  // Register address first, then data with auto increment
+  if (m_size > 0) {
+    s_i2cPointer[m_address] = m_buffer[0] % HAL_I2C_REGS;
+  }
+  for (uint8_t i = 1; i < m_size; i++) {
+    uint8_t _reg   = s_i2cPointer[m_address];
+    uint8_t _value = m_buffer[i];
+    if (0x05 == _reg) {
+      // IOCON of the MCP23008, only bits 1 to 5 exist
+      _value &= 0x3E;
+    }
+    s_i2cRegs[m_address][_reg] = _value;
+    if (NULL != s_i2cWrite) {
+      s_i2cWrite(m_address, _reg, _value);
+    }
+    s_i2cPointer[m_address] = (_reg + 1) % HAL_I2C_REGS;
+  }
+  m_size = 0;
+  return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity) {
+  m_address = address % HAL_I2C_DEVICES;
+  m_size    = min(quantity, (uint8_t)BUFFER_LENGTH);
+  m_index   = 0;
+  for (uint8_t i = 0; i < m_size; i++) {
+    uint8_t _reg = s_i2cPointer[m_address];
+    m_buffer[i]  = s_i2cRegs[m_address][_reg];
+    s_i2cPointer[m_address] = (_reg + 1) % HAL_I2C_REGS;
+  }
+  return m_size;
+}
+
+int TwoWire::available() {
+  return m_size - m_index;
+}
+
+int TwoWire::read() {
+  return (m_index < m_size) ? m_buffer[m_index++] : -1;
+}
+
+
+/*
+ * EEPROM
+ */
+EEPROMClass::EEPROMClass() {
+  memset(m_data, 0xFF, sizeof(m_data));
+}
+
+uint8_t EEPROMClass::read(int address) {
+  return m_data[address % (E2END + 1)];
+}
+
+void EEPROMClass::write(int address, uint8_t value) {
+  m_data[address % (E2END + 1)] = value;
+}
+
+
+/*
+ * Serial
+ */
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    write(buffer[i]);
+  }
+  return size;
+}
+
+void HardwareSerial::begin(unsigned long baud) {
+  // 10 bits per byte
+  s_serialRate = baud / 10;
+}
+
+void HardwareSerial::end() {}
+
+int HardwareSerial::available() {
+  return min(s_rx.size(), (size_t)(SERIAL_RX_BUFFER_SIZE - 1));
+}
+
+int HardwareSerial::read() {
+  if (s_rx.empty()) {
+    return -1;
+  }
+  uint8_t _value = s_rx.front();
+  s_rx.pop_front();
+  return _value;
+}
+
+int HardwareSerial::peek() {
+  return s_rx.empty() ? -1 : s_rx.front();
+}
+
+void HardwareSerial::flush() {
+  while (!s_tx.empty()) {
+    hal_advance(s_txDone - s_now);
+  }
+}
+
+size_t HardwareSerial::write(uint8_t value) {
+  // Like the AVR core, wait for room in the TX buffer
+  while (s_tx.size() >= SERIAL_TX_BUFFER_SIZE - 1) {
+    hal_advance(s_txDone - s_now);
+  }
+  if (s_tx.empty()) {
+    s_txDone = s_now + (s_serialRate ? 1000000ULL / s_serialRate : 0);
+  }
+  s_tx.push_back(value);
+  moveTo(s_now);
+  return 1;
+}
+
+void hal_serialReceive(const uint8_t* data, size_t size) {
+  s_rx.insert(s_rx.end(), data, data + size);
+}
+
+size_t hal_serialSent(uint8_t* data, size_t size) {
+  size_t _count = min(size, s_sent.size());
+  for (size_t i = 0; i < _count; i++) {
+    data[i] = s_sent.front();
+    s_sent.pop_front();
+  }
+  return _count;
+}
+
+void hal_serialRate(uint32_t bytesPerSecond) {
+  s_serialRate = bytesPerSecond;
+}
@@ -0,0 +1,73 @@
+// hal.h
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#ifndef HOST_HAL_H_
+#define HOST_HAL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Simulated board of the host build
+ *
+ * The firmware sees it through the Arduino API, simulations and the
+ * runner drive it through the functions below. Time only moves when
+ * told to: by hal_advance(), by delay() and by the sleep of the idle
+ * loop, which lasts until the next timer 0 overflow like on the AVR.
+ */
+
+#define HAL_PINS        20
+#define HAL_I2C_DEVICES 128
+#define HAL_I2C_REGS    16
+#define HAL_TIMER_TICK  1024  // us, timer 0 overflow of a 16MHz AVR
+
+/*! Simulated time in us since start */
+uint64_t hal_now();
+/*! Let time pass, the UART sends and scheduled events fire meanwhile */
+void hal_advance(uint64_t us);
+/*! Call back once at the given time, e.g. to drive pins like a machine
+ *  would; a sleep ends early for it. Replaces an event still pending.
+ */
+void hal_schedule(uint64_t at, void (*callback)());
+
+/*! Drive an input pin, fires an attached interrupt on a matching edge */
+void    hal_setPin(uint8_t pin, uint8_t value);
+/*! Level written by the firmware, or driven by hal_setPin() */
+uint8_t hal_getPin(uint8_t pin);
+/*! ADC reading of an analog channel, pin numbers A0.. or 0.. */
+void    hal_setAnalog(uint8_t pin, int value);
+
+/*! Register of an I2C device, MCP23008 style with auto increment */
+uint8_t hal_i2cRegister(uint8_t address, uint8_t reg);
+/*! Called for each register written over I2C, NULL for none */
+void    hal_onI2cWrite(void (*callback)(uint8_t address, uint8_t reg,
+                                        uint8_t value));
+
+/*! Bytes for the firmware to receive */
+void   hal_serialReceive(const uint8_t* data, size_t size);
+/*! Bytes the firmware sent, returns how many were copied */
+size_t hal_serialSent(uint8_t* data, size_t size);
+/*! Bytes per second of the UART, 0 for no limit,
+ *  Serial.begin() sets it from the baud rate
+ */
+void   hal_serialRate(uint32_t bytesPerSecond);
+
+#endif  // HOST_HAL_H_
@@ -0,0 +1,96 @@
+// runner.cpp
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+/*
+ * Runs the firmware on the simulated board of the host build
+ *
+ * The serial port is connected to stdin and stdout, so a host
+ * application or a script can talk SLIP to it through a pipe or a pty:
+ *
+ *   ayab-host [-t ms] [-f] < requests.bin > replies.bin
+ *
+ * Without -t the run ends one simulated second after stdin is closed.
+ * -f runs the UART without a baud rate limit.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "./Arduino.h"
+
+void setup();
+void loop();
+
+
+int main(int argc, char** argv) {
+  uint64_t _duration = 0;
+  bool     _fast     = false;
+
+  int _option;
+  while ((_option = getopt(argc, argv, "t:f")) != -1) {
+    switch (_option) {
+      case 't':
+        _duration = strtoull(optarg, NULL, 10) * 1000;
+        break;
+      case 'f':
+        _fast = true;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-t ms] [-f]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+
+  setup();
+  if (_fast) {
+    hal_serialRate(0);
+  }
+
+  bool     _inputOpen = true;
+  uint64_t _end       = _duration;
+  uint8_t  _buffer[256];
+  while (0 == _end || hal_now() < _end) {
+    if (_inputOpen) {
+      ssize_t _read = read(STDIN_FILENO, _buffer, sizeof(_buffer));
+      if (_read > 0) {
+        hal_serialReceive(_buffer, _read);
+      } else if (0 == _read || EAGAIN != errno) {
+        _inputOpen = false;
+        if (0 == _duration) {
+          _end = hal_now() + 1000000ULL;
+        }
+      }
+    }
+
+    loop();
+
+    size_t _sent;
+    while ((_sent = hal_serialSent(_buffer, sizeof(_buffer))) > 0) {
+      fwrite(_buffer, 1, _sent, stdout);
+    }
+    fflush(stdout);
+  }
+  return 0;
+}
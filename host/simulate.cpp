@@ -0,0 +1,424 @@
+// simulate.cpp
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+/*
+ * Knits a random pattern with a simulated carriage and checks every needle
+ *
+ *   ayab-sim [options]
+ *     -c K|L         carriage (K)
+ *     -v speed       needles/s at full speed (200)
+ *     -a accel       needles/s^2, 0 turns around at full speed (0)
+ *     -w start,stop  needles of the pattern (0,199)
+ *     -s left,right  turnaround positions of the strokes (1,254)
+ *     -b phase       belt phase, 8 Regular, 0 Shifted (8)
+ *     -n lines       lines of the pattern (10)
+ *     -l ms          host response time to reqLine (0)
+ *     -r seed        pattern seed (1)
+ *     -o file        record of every solenoid write as CSV
+ *     -S from,to,step  sweep the speed, one fresh firmware per speed
+ *     -d             list the wrongly set needles
+ *
+ * Exits with 0 if every needle was right, 2 if some were wrong and 1
+ * if the run did not get to the end of work.
+ *
+ * The simulation plays the host as well: it answers reqLine with cnfLine
+ * and knows which needle should have been selected on every pass,
+ * needles of the bed outside of the pattern never. A
+ * needle counts as set when its solenoid is right as the carriage moves
+ * on from the encoder position the firmware set it at.
+ *
+ * The firmware runs in zero simulated time, so the speed limit found
+ * comes from the link, the line timing and the scheduler, not from the
+ * CPU; see the simavr benchmark for cycle counts.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "./Arduino.h"
+#include "./carriage.h"
+#include "./Encoding/SLIP.h"
+
+#define SIM_TIMEOUT 600000000ULL  // us
+#define SIM_FAILED  UINT32_MAX    // simulate() did not get to the end
+#define SOLENOIDS_LOW  0x20       // I2C address of the expander
+#define SOLENOIDS_HIGH 0x21
+#define MCP23008_GPIO  0x09
+
+void setup();
+void loop();
+
+typedef struct Options {
+  Carriage_t carriage;
+  float      speed;
+  float      acceleration;
+  byte       startNeedle;
+  byte       stopNeedle;
+  int        left;
+  int        right;
+  byte       beltPhase;
+  byte       lines;
+  uint32_t   latency;  // us
+  unsigned   seed;
+  FILE*      record;
+  bool       verbose;
+} Options_t;
+
+static Options_t s_options;
+static VirtualCarriage* s_carriage;
+
+// Host side
+static byte     s_pattern[256][LINEBUFFER_LEN];
+static uint8_t  s_frame[256];
+static size_t   s_frameSize = 0;
+static bool     s_initialized     = false;
+static bool     s_started   = false;
+static bool     s_endWork   = false;
+static bool     s_answer    = false;
+static byte     s_answerLine;
+static uint64_t s_answerTime;
+static int      s_linesSent = 0;
+
+// Check of the needles
+static int      s_pass    = -1;  // line knitted by the current stroke
+static bool     s_regular;
+static uint32_t s_checked = 0;
+static uint32_t s_wrong   = 0;
+
+
+static void send(const uint8_t* payload, size_t size) {
+  uint8_t _encoded[2 * 64 + 2];
+  size_t  _size = SLIP::encode(payload, size, _encoded);
+  _encoded[_size++] = SLIP::END;
+  hal_serialReceive(_encoded, _size);
+}
+
+
+static void sendLine(byte lineNumber) {
+  uint8_t payload[LINEBUFFER_LEN + 4];
+  payload[0] = cnfLine_msgid;
+  payload[1] = lineNumber;
+  memcpy(&payload[2], s_pattern[lineNumber], LINEBUFFER_LEN);
+  payload[LINEBUFFER_LEN + 2] = (lineNumber + 1 >= s_options.lines) ? 1 : 0;
+  payload[LINEBUFFER_LEN + 3] = 0;  // crc8, not checked
+  send(payload, sizeof(payload));
+}
+
+
+static void received(const uint8_t* payload, size_t size) {
+  switch (payload[0]) {
+    case indState_msgid:
+      if (size > 1 && payload[1]) {
+        s_initialized = true;
+      }
+      break;
+
+    case cnfStart_msgid:
+      s_started = (size > 1 && payload[1]);
+      break;
+
+    case reqLine_msgid:
+      s_answer     = true;
+      s_answerLine = payload[1];
+      s_answerTime = hal_now() + s_options.latency;
+      break;
+
+    case indEndWork_msgid:
+      s_endWork = true;
+      break;
+
+    default:
+      break;
+  }
+}
+
+
+static void receive() {
+  uint8_t _buffer[64];
+  size_t  _size;
+  while ((_size = hal_serialSent(_buffer, sizeof(_buffer))) > 0) {
+    for (size_t i = 0; i < _size; i++) {
+      if (SLIP::END != _buffer[i]) {
+        if (s_frameSize < sizeof(s_frame)) {
+          s_frame[s_frameSize++] = _buffer[i];
+        }
+      } else if (s_frameSize > 0) {
+        uint8_t _payload[sizeof(s_frame)];
+        received(_payload, SLIP::decode(s_frame, s_frameSize, _payload));
+        s_frameSize = 0;
+      }
+    }
+  }
+}
+
+
+static uint16_t getSolenoids() {
+  return (hal_i2cRegister(SOLENOIDS_HIGH, MCP23008_GPIO) << 8)
+         | hal_i2cRegister(SOLENOIDS_LOW, MCP23008_GPIO);
+}
+
+
+/*! Needle and solenoid as in Knitter::calculatePixelAndSolenoid() */
+static void positionLeft(byte position, Direction_t direction) {
+  if (s_pass < 0 || s_pass >= s_options.lines) {
+    return;
+  }
+  int  _needle;
+  byte _solenoid;
+  if (Right == direction) {
+    // The firmware only sets needles from position 40 on, so going right
+    // the L carriage's needles 0-7 (positions 32-39) are never set. This
+    // is the firmware's mapping, not checked against a machine; they are
+    // left out here rather than changed without one.
+    if (position < 40) {
+      return;
+    }
+    _needle   = position - 40 + ((L == s_options.carriage) ? 8 : 0);
+    _solenoid = (s_regular ? position : position - 8) % 16;
+  } else {
+    _needle   = position - 16 - ((L == s_options.carriage) ? 16 : 0);
+    _solenoid = (s_regular ? position + 8 : position) % 16;
+  }
+  if (_needle < 0 || _needle >= NUM_NEEDLES) {
+    return;
+  }
+
+  // Solenoid active, i.e. low, selects the needle,
+  // those outside of the pattern are never selected
+  bool _expected = _needle >= s_options.startNeedle
+                   && _needle <= s_options.stopNeedle
+                   && bitRead(s_pattern[s_pass][_needle / 8], _needle % 8);
+  bool _selected = !bitRead(getSolenoids(), _solenoid);
+  s_checked++;
+  if (_expected != _selected) {
+    s_wrong++;
+    if (s_options.verbose) {
+      fprintf(stderr, "line %d, needle %d: %s\n", s_pass, _needle,
+              _expected ? "not selected" : "selected");
+    }
+  }
+}
+
+
+static void solenoidsWritten(uint8_t address, uint8_t reg, uint8_t) {
+  if (MCP23008_GPIO == reg
+      && (SOLENOIDS_LOW == address || SOLENOIDS_HIGH == address)) {
+    fprintf(s_options.record, "%llu,%.2f,%c,%04x\n",
+            (unsigned long long)hal_now(), s_carriage->getPosition(),
+            (Right == s_carriage->getDirection()) ? 'R' : 'L',
+            getSolenoids());
+  }
+}
+
+
+/*! Run the firmware until the predicate holds, false on timeout */
+static bool runUntil(bool (*done)()) {
+  while (!done()) {
+    if (hal_now() > SIM_TIMEOUT) {
+      return false;
+    }
+    loop();
+    receive();
+    if (s_answer && hal_now() >= s_answerTime) {
+      s_answer = false;
+      if (s_answerLine < s_options.lines) {
+        sendLine(s_answerLine);
+        s_linesSent++;
+      }
+    }
+  }
+  return true;
+}
+
+static bool isInitialized()      { return s_initialized; }
+static bool isStarted()    { return s_started; }
+static bool isFirstLine()  { return s_linesSent > 0; }
+static bool isStopped()    { return !s_carriage->isMoving(); }
+
+
+/*! Knit the pattern, returns the number of wrongly set needles
+ *  or SIM_FAILED
+ */
+static uint32_t simulate(float speed) {
+  setup();
+  VirtualCarriage _carriage(s_options.carriage, s_options.left + 16);
+  s_carriage = &_carriage;
+  _carriage.setSpeed(speed, s_options.acceleration);
+  _carriage.setBeltPhase(s_options.beltPhase);
+  _carriage.onPosition(&positionLeft);
+  s_regular = ((HALL_LEFT_POSITION + s_options.beltPhase) & 0x0F) < 8;
+  if (s_options.record) {
+    hal_onI2cWrite(&solenoidsWritten);
+  }
+
+  // Pass the left hall sensor to initialize the machine
+  _carriage.moveTo(HALL_LEFT_POSITION + 2);
+  if (!runUntil(&isInitialized) || !runUntil(&isStopped)) {
+    fprintf(stderr, "machine not initialized\n");
+    return SIM_FAILED;
+  }
+
+  uint8_t _reqStart[4] = {reqStart_msgid, s_options.startNeedle,
+                          s_options.stopNeedle, 0};
+  send(_reqStart, sizeof(_reqStart));
+  if (!runUntil(&isStarted) || !runUntil(&isFirstLine)) {
+    fprintf(stderr, "knitting not started\n");
+    return SIM_FAILED;
+  }
+
+  // One line per stroke, plus one to see the end of work
+  for (s_pass = 0; s_pass <= s_options.lines && !s_endWork; s_pass++) {
+    _carriage.moveTo((s_pass % 2) ? s_options.left : s_options.right);
+    if (!runUntil(&isStopped)) {
+      break;
+    }
+  }
+  if (!s_endWork) {
+    fprintf(stderr, "no end of work\n");
+  }
+  return s_endWork ? s_wrong : SIM_FAILED;
+}
+
+
+/*! Print the result of simulate(), returns the exit status */
+static int report(float speed, uint32_t wrong) {
+  if (SIM_FAILED == wrong) {
+    printf("%.0f needles/s: failed after %u needles\n", speed, s_checked);
+    return 1;
+  }
+  printf("%.0f needles/s: %u of %u needles wrong\n", speed, wrong, s_checked);
+  return (0 == wrong) ? 0 : 2;
+}
+
+
+static bool parsePair(const char* text, int* first, int* second) {
+  return 2 == sscanf(text, "%d,%d", first, second);
+}
+
+
+int main(int argc, char** argv) {
+  s_options.carriage     = K;
+  s_options.speed        = 200;
+  s_options.acceleration = 0;
+  s_options.startNeedle  = 0;
+  s_options.stopNeedle   = NUM_NEEDLES - 1;
+  s_options.left         = 1;
+  s_options.right        = 254;
+  s_options.beltPhase    = 8;
+  s_options.lines        = 10;
+  s_options.latency      = 0;
+  s_options.seed         = 1;
+  s_options.record       = NULL;
+  s_options.verbose      = false;
+
+  float _sweep[3] = {0, 0, 0};
+  int   _first, _second;
+  int   _option;
+  while ((_option = getopt(argc, argv, "c:v:a:w:s:b:n:l:r:o:S:d")) != -1) {
+    switch (_option) {
+      case 'c':
+        s_options.carriage = ('L' == optarg[0]) ? L : K;
+        break;
+      case 'v':
+        s_options.speed = atof(optarg);
+        break;
+      case 'a':
+        s_options.acceleration = atof(optarg);
+        break;
+      case 'w':
+        if (!parsePair(optarg, &_first, &_second)) {
+          return 1;
+        }
+        s_options.startNeedle = _first;
+        s_options.stopNeedle  = _second;
+        break;
+      case 's':
+        if (!parsePair(optarg, &s_options.left, &s_options.right)) {
+          return 1;
+        }
+        break;
+      case 'b':
+        s_options.beltPhase = atoi(optarg);
+        break;
+      case 'n':
+        s_options.lines = min(atoi(optarg), 255);
+        break;
+      case 'l':
+        s_options.latency = atof(optarg) * 1000;
+        break;
+      case 'r':
+        s_options.seed = atoi(optarg);
+        break;
+      case 'o':
+        s_options.record = fopen(optarg, "w");
+        if (NULL == s_options.record) {
+          perror(optarg);
+          return 1;
+        }
+        fprintf(s_options.record, "time_us,position,direction,solenoids\n");
+        break;
+      case 'S':
+        if (3 != sscanf(optarg, "%f,%f,%f", &_sweep[0], &_sweep[1],
+                        &_sweep[2]) || _sweep[2] <= 0) {
+          return 1;
+        }
+        break;
+      case 'd':
+        s_options.verbose = true;
+        break;
+      default:
+        fprintf(stderr, "usage: see the top of simulate.cpp\n");
+        return 1;
+    }
+  }
+
+  srand(s_options.seed);
+  for (int i = 0; i < s_options.lines; i++) {
+    for (int j = 0; j < LINEBUFFER_LEN; j++) {
+      s_pattern[i][j] = rand() & 0xFF;
+    }
+  }
+
+  if (0 == _sweep[2]) {
+    return report(s_options.speed, simulate(s_options.speed));
+  }
+
+  // Each speed gets a firmware fresh from reset
+  float _reliable = 0;
+  for (float speed = _sweep[0]; speed <= _sweep[1]; speed += _sweep[2]) {
+    fflush(stdout);
+    pid_t _child = fork();
+    if (0 == _child) {
+      int _status = report(speed, simulate(speed));
+      fflush(stdout);
+      _exit(_status);
+    }
+    int _status;
+    waitpid(_child, &_status, 0);
+    if (!WIFEXITED(_status) || 0 != WEXITSTATUS(_status)) {
+      break;
+    }
+    _reliable = speed;
+  }
+  printf("maximum reliable speed: %.0f needles/s\n", _reliable);
+  return 0;
+}
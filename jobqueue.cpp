@@ -0,0 +1,61 @@
+// jobqueue.cpp
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#include "Arduino.h"
+#include "./jobqueue.h"
+
+
+JobQueue::JobQueue() {
+  clear();
+}
+
+
+void JobQueue::clear() {
+  m_first = 0;
+  m_count = 0;
+}
+
+
+bool JobQueue::push(const Job_t* job) {
+  if (m_count >= JOBQUEUE_LEN) {
+    return false;
+  }
+  byte _slot = (m_first + m_count) % JOBQUEUE_LEN;
+  m_jobs[_slot] = *job;
+  m_count++;
+  return true;
+}
+
+
+bool JobQueue::pop(Job_t* job) {
+  if (0 == m_count) {
+    return false;
+  }
+  *job    = m_jobs[m_first];
+  m_first = (m_first + 1) % JOBQUEUE_LEN;
+  m_count--;
+  return true;
+}
+
+
+byte JobQueue::getCount() {
+  return m_count;
+}
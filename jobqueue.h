@@ -0,0 +1,56 @@
+// jobqueue.h
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#ifndef JOBQUEUE_H_
+#define JOBQUEUE_H_
+
+#include "Arduino.h"
+#include "./settings.h"
+
+typedef struct Job {
+  byte         startNeedle;
+  byte         stopNeedle;
+  Carriage_t   carriage;    // NoCarriage: any carriage
+  LineSource_t lineSource;
+  bool         hasHash;
+  uint16       hash;        // stored pattern for SourceStored
+} Job_t;
+
+/*!
+ *  Jobs knitted back to back after the one started with reqStart
+ */
+class JobQueue {
+ public:
+  JobQueue();
+
+  void   clear();
+  bool   push(const Job_t* job);
+  /*! Take the next job, false if there is none */
+  bool   pop(Job_t* job);
+  byte   getCount();
+
+ private:
+  Job_t  m_jobs[JOBQUEUE_LEN];
+  byte   m_first;
+  byte   m_count;
+};
+
+#endif  // JOBQUEUE_H_
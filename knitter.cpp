@@ -24,19 +24,27 @@ This file is part of AYAB.
 
 Knitter::Knitter() {}
 
-Knitter::Knitter(SLIPPacketSerial* packetSerial) {
+Knitter::Knitter(TxQueue* txQueue) {
   Knitter();
-  m_packetSerial = packetSerial;
+  m_txQueue = txQueue;
   m_opState           = s_init;
   m_startNeedle       = 0;
   m_stopNeedle        = 0;
-  m_currentLineNumber = 0;
-  m_lineRequested     = false;
+  m_edgeTime          = 0;
+  m_report.fields     = 0;
+  m_report.interval   = 0;
+  m_report.time       = 0;
+  resetJob();
+#ifdef DBG_NOMACHINE
+  m_buttonState       = false;
+#endif
 
   m_solenoids.init();
+  m_patternStore.init();
 }
 
 void Knitter::isr() {
+  m_edgeTime = micros();
   // Update machine state data
   m_encoders.encA_interrupt();
   m_position   = m_encoders.getPosition();
@@ -44,83 +52,254 @@ void Knitter::isr() {
   m_hallActive = m_encoders.getHallActive();
   m_beltshift  = m_encoders.getBeltshift();
   m_carriage   = m_encoders.getCarriage();
+
+  TRACE_EVENT(TraceEdge, m_position, m_direction);
+  if (NoDirection != m_hallActive) {
+    TRACE_EVENT(TraceHall, m_hallActive, (m_carriage << 8) | m_beltshift);
+  }
 }
 
-void Knitter::fsm() {  
-  switch (m_opState) {
-    case s_init:
-      state_init();
-      break;
+void Knitter::fsm() {
+  (this->*s_stateTable[m_opState].handler)();
+}
 
-    case s_ready:
-      state_ready();
-      break;
+void Knitter::updateBeeper() {
+  m_beeper.update();
+}
 
-    case s_operate:
-      state_operate();
-      break;
+void Knitter::updateHallValues() {
+  m_encoders.updateHallValues();
+}
 
-    case s_test:
-      state_test();
-      break;
+void Knitter::reportState() {
+  // Called by the telemetry task, which limits either kind of report
+  // to its period; the host may ask for a longer interval
+  if (s_operate != m_opState || !m_continuousReportingEnabled
+      || millis() - m_report.time < m_report.interval) {
+    return;
+  }
 
-    default:
-      break;
+  if (0 != m_report.fields) {
+    indStateDelta();
+  } else if (m_report.position != m_position) {
+    // Send current position to GUI
+    m_report.position = m_position;
+    m_report.time     = millis();
+    indState(true);
+  }
+}
+
+bool Knitter::setReporting(byte fields, uint16 interval) {
+  if (fields & ~ReportAll) {
+    return false;
   }
+  m_report.fields    = fields;
+  m_report.interval  = interval;
+  // Start over with a complete report
+  m_report.sinceFull = REPORT_FULL_EVERY;
+  return true;
 }
 
 bool Knitter::startOperation(byte startNeedle,
                              byte stopNeedle,
                              bool continuousReportingEnabled,
-                             byte(*line)) {
+                             LineSource_t lineSource) {
   if (startNeedle >= 0
       && stopNeedle < NUM_NEEDLES
-      && startNeedle < stopNeedle) {
-    if (s_ready == m_opState) {
-      // Proceed to next state
-      m_opState = s_operate;
-      // Assign image width
-      m_startNeedle  = startNeedle;
-      m_stopNeedle   = stopNeedle;
-      // Continuous Reporting enabled?
-      m_continuousReportingEnabled = continuousReportingEnabled;
-      // Set pixel data source
-      m_lineBuffer   = line;
-
-      // Reset variables to start conditions
-      m_currentLineNumber  = 255;  // because counter will
-                                   // be increased before request
-      m_lineRequested      = false;
-      m_lastLineFlag       = false;
-      m_lastLinesCountdown = 2;
-
-      m_beeper.ready();
-
-      return true;
+      && startNeedle < stopNeedle
+      && lineSource <= SourceStored
+      && isSourceReady(lineSource)
+      && isAllowed(s_operate)) {
+    if (SourceStored == lineSource && !m_patternStore.rewind()) {
+      // Nothing stored to knit from
+      return false;
     }
+    // Assign image width
+    m_startNeedle  = startNeedle;
+    m_stopNeedle   = stopNeedle;
+    // Continuous Reporting enabled?
+    m_continuousReportingEnabled = continuousReportingEnabled;
+    // Set pixel data source
+    m_lineSource   = lineSource;
+    m_expectedCarriage = NoCarriage;
+
+    // Reset variables to start conditions
+    m_lines.reset(startNeedle, stopNeedle);
+    m_motif.reset();
+    m_colourLine.reset();
+    m_laceLine.reset();
+    resetJob();
+
+    // Proceed to next state
+    setState(s_operate);
+    LOG2(LogJobStarted, startNeedle, stopNeedle);
+    m_beeper.ready();
+    return true;
   }
   return false;
 }
 
 bool Knitter::startTest() {
-  if (s_init == m_opState
-      || s_ready == m_opState) {
-    m_opState = s_test;
+  if (setState(s_test)) {
+    resetJob();
     return true;
   }
   return false;
 }
 
-bool Knitter::setNextLine(byte lineNumber) {
-  if (m_lineRequested) {
-    // Is there even a need for a new line?
-    if (lineNumber == m_currentLineNumber) {
-      m_lineRequested = false;
-      m_beeper.finishedLine();
+bool Knitter::queueJob(const Job_t* job) {
+  if (job->startNeedle >= job->stopNeedle
+      || job->stopNeedle >= NUM_NEEDLES
+      || job->carriage > G
+      || job->lineSource > SourceStored
+      || !isSourceReady(job->lineSource)) {
+    return false;
+  }
+  return m_jobs.push(job);
+}
+
+void Knitter::clearJobs() {
+  m_jobs.clear();
+}
+
+byte Knitter::getQueuedJobs() {
+  return m_jobs.getCount();
+}
+
+bool Knitter::isSourceReady(LineSource_t lineSource) {
+  // Parameters of reqStart, which queued jobs reuse
+  switch (lineSource) {
+    case SourceMotif:
+      return m_motif.isLoaded();
+    case SourceColour:
+      return m_colourLine.isConfigured();
+    case SourceLace:
+      return m_laceLine.isConfigured();
+    default:
       return true;
-    } else {
-    //  line numbers didnt match -> request again
-    reqLine(m_currentLineNumber);
+  }
+}
+
+bool Knitter::setMotif(const uint8_t* data, size_t size) {
+  if (s_operate == m_opState) {
+    // Motif is in use
+    return false;
+  }
+  return m_motif.load(data, size);
+}
+
+bool Knitter::setColours(const uint8_t* data, size_t size) {
+  if (s_operate == m_opState) {
+    // Colour parameters are in use
+    return false;
+  }
+  return m_colourLine.configure(data, size);
+}
+
+bool Knitter::setLace(const uint8_t* data, size_t size) {
+  if (s_operate == m_opState) {
+    // Lace parameters are in use
+    return false;
+  }
+  return m_laceLine.configure(data, size);
+}
+
+bool Knitter::storePattern(uint16 offset, const uint8_t* data, size_t size) {
+  if (s_operate == m_opState) {
+    // Stored pattern may be in use
+    return false;
+  }
+  return m_patternStore.write(offset, data, size);
+}
+
+uint16 Knitter::getStoredBytes() {
+  return m_patternStore.getReceived();
+}
+
+bool Knitter::selectPattern(uint16 hash) {
+  if (s_operate == m_opState) {
+    // Stored pattern may be in use
+    return false;
+  }
+  return m_patternStore.select(hash);
+}
+
+bool Knitter::setNextLine(byte lineNumber, const byte* line,
+                          byte startNeedle, byte stopNeedle) {
+  if (s_operate == m_opState && SourceHost == m_lineSource) {
+    // Only narrow down, the job's range stays the outer limit
+    if (startNeedle < m_startNeedle) {
+      startNeedle = m_startNeedle;
+    }
+    if (stopNeedle > m_stopNeedle) {
+      stopNeedle = m_stopNeedle;
+    }
+
+    // Is there even room for a new line?
+    if (startNeedle <= stopNeedle
+        && lineNumber == m_lines.getNextNumber() && m_lines.push(line)) {
+      // Range has to be set before the line can become the current one
+      Line_t* _line = m_lines.getLast();
+      _line->startNeedle = startNeedle;
+      _line->stopNeedle  = stopNeedle;
+      LOG1(LogLineAccepted, lineNumber);
+      TRACE_EVENT(TraceLineAccepted, lineNumber, 0);
+      m_job.lineRequested = false;
+      if (m_job.waitingForLine) {
+        nextLine();
+      }
+      return true;
+    } else if (m_job.lineRequested) {
+      //  line numbers didnt match or no needle left -> request again
+      LOG2(LogLineRejected, lineNumber, m_lines.getNextNumber());
+      reqLine(nextLineNumber());
+    }
+  }
+  return false;
+}
+
+
+bool Knitter::setColourLine(byte lineNumber,
+                            const uint8_t* data, size_t size) {
+  if (s_operate == m_opState && SourceColour == m_lineSource) {
+    // All passes of the previous line have to be out
+    if (lineNumber == m_job.colourLineNumber
+        && !m_colourLine.hasPass()
+        && m_colourLine.load(data, size)) {
+      TRACE_EVENT(TraceLineAccepted, lineNumber, 0);
+      m_job.colourLineNumber++;
+      m_job.colourLastLine = false;
+      m_job.lineRequested  = false;
+      if (m_job.waitingForLine) {
+        nextLine();
+      }
+      return true;
+    } else if (m_job.lineRequested) {
+      //  line numbers didnt match -> request again
+      reqLine(nextLineNumber());
+    }
+  }
+  return false;
+}
+
+
+bool Knitter::setLaceLine(byte lineNumber,
+                          const uint8_t* data, size_t size) {
+  if (s_operate == m_opState && SourceLace == m_lineSource) {
+    // Passes of the previous chart line have to be finished
+    byte _blank[LINEBUFFER_LEN];
+    memset(_blank, 0xFF, LINEBUFFER_LEN);
+    if (lineNumber == m_lines.getNextNumber()
+        && m_job.waitingForLine
+        && m_laceLine.load(data, size)
+        && m_lines.push(_blank)) {
+      TRACE_EVENT(TraceLineAccepted, lineNumber, 0);
+      m_job.lineRequested = false;
+      nextLine();
+      return true;
+    } else if (m_job.lineRequested) {
+      //  line numbers didnt match -> request again
+      reqLine(nextLineNumber());
     }
   }
   return false;
@@ -128,42 +307,98 @@ bool Knitter::setNextLine(byte lineNumber) {
 
 
 void Knitter::setLastLine() {
-  // lastLineFlag is evaluated in s_operate
-  m_lastLineFlag = true;
+  // lastLine is evaluated in s_operate
+  if (SourceColour == m_lineSource) {
+    // applies to the last pass, derived later on
+    m_job.colourLastLine = true;
+  } else {
+    m_lines.getLast()->lastLine = true;
+  }
+}
+
+
+void Knitter::requestLineAgain() {
+  if (m_job.lineRequested) {
+    reqLine(nextLineNumber());
+  }
+}
+
+
+const byte* Knitter::getLastLine() {
+  return m_lines.getLast()->data;
 }
 
 
 /*
  * PRIVATE METHODS
  */
-void Knitter::state_init() {
-  static bool _ready = false;
 
-#ifdef DBG_NOMACHINE
-  static bool _prevState = false;
-  bool state = digitalRead(DBG_BTN_PIN);
+// Handler and states reachable from there, in order of OpState_t
+const Knitter::StateEntry_t Knitter::s_stateTable[s_test + 1] = {
+  {&Knitter::state_init,    bit(s_ready) | bit(s_test)},     // s_init
+  {&Knitter::state_ready,   bit(s_operate) | bit(s_test)},   // s_ready
+  {&Knitter::state_operate, bit(s_ready)},                   // s_operate
+  {&Knitter::state_test,    0}                               // s_test
+};
 
-  // TODO Check if debounce is needed
-  if (_prevState && !state) {
-    _ready = true;
+bool Knitter::isAllowed(OpState_t state) {
+  return bitRead(s_stateTable[m_opState].next, state);
+}
+
+bool Knitter::setState(OpState_t state) {
+  if (!isAllowed(state)) {
+    return false;
   }
-  _prevState = state;
+  LOG2(LogStateChanged, m_opState, state);
+  TRACE_EVENT(TraceStateChanged, m_opState, state);
+  m_opState = state;
+  return true;
+}
+
+void Knitter::resetJob() {
+  m_job.firstRun          = true;
+  m_job.oldPosition       = 0;
+  m_job.workedOnLine      = false;
+  m_job.lineRequested     = false;
+  m_job.waitingForLine    = true;
+  m_job.lineDoneDirection = NoDirection;
+  m_job.linesKnitted      = 0;
+  m_job.colourLineNumber  = 0;
+  m_job.colourLastLine    = false;
+  m_job.startTime         = millis();
+  m_job.lineWait          = 0;
+  m_job.needlesSelected   = 0;
+  m_row.waiting           = false;
+  resetRow();
+
+  // First report of the job is a complete one
+  m_report.position  = 0;
+  m_report.sinceFull = REPORT_FULL_EVERY;
+}
+
+#ifdef DBG_NOMACHINE
+bool Knitter::buttonReleased() {
+  bool _state    = digitalRead(DBG_BTN_PIN);
+  // TODO Check if debounce is needed
+  bool _released = m_buttonState && !_state;
+  m_buttonState  = _state;
+  return _released;
+}
+#endif  // DBG_NOMACHINE
+
+void Knitter::state_init() {
+#ifdef DBG_NOMACHINE
+  bool _ready = buttonReleased();
 #else
   // Machine is initialized when left hall sensor is passed in Right direction
-  if (Right == m_direction
-      && Left == m_hallActive) {
-    _ready = true;
-  }
+  bool _ready = (Right == m_direction && Left == m_hallActive);
 #endif  // DBG_NOMACHINE
 
   if (_ready) {
-    m_opState = s_ready;
+    setState(s_ready);
     m_solenoids.setSolenoids(0xFFFF);
-    indState(true);
-    return;
+    indState(true, TxHigh);
   }
-
-  m_opState = s_init;
 }
 
 
@@ -176,78 +411,94 @@ void Knitter::state_ready() {
 
 void Knitter::state_operate() {
   digitalWrite(LED_PIN_A, 1);
-  static bool _firstRun     = true;
-  static byte _sOldPosition = 0;
-  static bool _workedOnLine = false;
 
-  if (true == _firstRun) {
-    _firstRun = false;
+  if (m_job.firstRun) {
+    m_job.firstRun = false;
     // Optimize Delay for various Arduino Models
     delay(2000);
     m_beeper.finishedLine();
-    reqLine(++m_currentLineNumber);
+    nextLine();
   }
 
 #ifdef DBG_NOMACHINE
-  static bool _prevState = false;
-  bool state = digitalRead(DBG_BTN_PIN);
-
-  // TODO Check if debounce is needed
-  if (_prevState && !state) {
-    if (!m_lineRequested) {
-      reqLine(++m_currentLineNumber);
-    }
+  if (buttonReleased()) {
+    nextLine();
   }
-  _prevState = state;
   return;
 #else
-  if (_sOldPosition != m_position) {
+  if (m_job.oldPosition != m_position) {
     // Only act if there is an actual change of position
     // Store current Encoder position for next call of this function
-    _sOldPosition = m_position;
+    m_job.oldPosition = m_position;
 
-    if (m_continuousReportingEnabled) {
-      // Send current position to GUI
-      indState(true);
-    }
-    
     if (!calculatePixelAndSolenoid()) {
       // No valid/useful position calculated
       return;
     }
 
-    if ((m_pixelToSet >= m_startNeedle-END_OF_LINE_OFFSET_L)
-        && (m_pixelToSet <= m_stopNeedle+END_OF_LINE_OFFSET_R)) {
-      
-      if ((m_pixelToSet >= m_startNeedle) && (m_pixelToSet <= m_stopNeedle)) {
-        _workedOnLine = true;
+    if (NoCarriage != m_expectedCarriage
+        && m_carriage != m_expectedCarriage) {
+      // Not the carriage this panel is meant for, select nothing
+      m_solenoids.setSolenoid(m_solenoidToSet, true);
+      return;
+    }
+
+    if (NoDirection != m_job.lineDoneDirection) {
+      if (m_direction == m_job.lineDoneDirection) {
+        // Still travelling on after the previous line,
+        // this one only starts with the turnaround
+        m_solenoids.setSolenoid(m_solenoidToSet, true);
+        return;
       }
+      m_job.lineDoneDirection = NoDirection;
+    }
 
-      // Find the right byte from the currentLine array,
-      // then read the appropriate Pixel(/Bit) for the current needle to set
-      int _currentByte = (int)(m_pixelToSet/8);
-      bool _pixelValue = bitRead(m_lineBuffer[_currentByte],
-                                 m_pixelToSet-(8*_currentByte));
-      // Write Pixel state to the appropriate needle
-      m_solenoids.setSolenoid(m_solenoidToSet, _pixelValue);
+    Line_t* _line = m_lines.getCurrent();
+    if ((m_pixelToSet >= _line->startNeedle-END_OF_LINE_OFFSET_L)
+        && (m_pixelToSet <= _line->stopNeedle+END_OF_LINE_OFFSET_R)) {
+
+      if ((m_pixelToSet >= _line->startNeedle)
+          && (m_pixelToSet <= _line->stopNeedle)) {
+        m_job.workedOnLine   = true;
+
+        // Write Pixel state to the appropriate needle
+        bool _pixelValue = getPixelValue(_line, m_pixelToSet, m_direction);
+        m_solenoids.setSolenoid(m_solenoidToSet, _pixelValue);
+
+        noInterrupts();
+        unsigned long _edgeTime = m_edgeTime;
+        interrupts();
+        latencies[LatencyEdge].add(micros() - _edgeTime);
+        countNeedle(_edgeTime, _pixelValue);
+      } else if (isBeforeLine(_line) && !m_job.waitingForLine) {
+        // The next needle is the first of the line
+        armSolenoids();
+      } else {
+        m_solenoids.setSolenoid(m_solenoidToSet, true);
+      }
     } else {  // Outside of the active needles
       //  digitalWrite(LED_PIN_B, 0);
 
       // Reset Solenoids when out of range
       m_solenoids.setSolenoid(m_solenoidToSet, true);
 
-      if (_workedOnLine) {
+      if (m_job.workedOnLine) {
         // already worked on the current line -> finished the line
-        _workedOnLine   = false;
-
-        if (!m_lineRequested && !m_lastLineFlag) {
-          // request new Line from Host
-          reqLine(++m_currentLineNumber);
-        } else if (m_lastLineFlag) {
-          m_beeper.endWork();
-          m_opState = s_ready;
-          m_solenoids.setSolenoids(0xFFFF);
+        m_job.workedOnLine   = false;
+        m_job.lineDoneDirection = m_direction;
+        m_job.linesKnitted++;
+        LOG1(LogLineDone, m_job.linesKnitted);
+        indRow();
+
+        if (SourceLace == m_lineSource
+            && !m_laceLine.finishPass(m_carriage)) {
+          // more passes to go on the same chart line
           m_beeper.finishedLine();
+        } else if (!_line->lastLine) {
+          // continue with the next line, request it if not there yet
+          nextLine();
+        } else {
+          endWork();
         }
       }
     }
@@ -257,12 +508,10 @@ void Knitter::state_operate() {
 
 
 void Knitter::state_test() {
-  static byte _sOldPosition = 0;
-
-  if (_sOldPosition != m_position) {
+  if (m_job.oldPosition != m_position) {
     // Only act if there is an actual change of position
     // Store current Encoder position for next call of this function
-    _sOldPosition = m_position;
+    m_job.oldPosition = m_position;
 
     calculatePixelAndSolenoid();
     indState();
@@ -279,9 +528,9 @@ bool Knitter::calculatePixelAndSolenoid() {
       if (m_position >= getStartOffset(Left)) {
         m_pixelToSet = m_position - getStartOffset(Left);
 
-        if (Regular == m_beltshift) {
+        if (Regular == m_beltshift || Lace_Regular == m_beltshift) {
           m_solenoidToSet = m_position % 16;
-        } else if (Shifted == m_beltshift) {
+        } else if (Shifted == m_beltshift || Lace_Shifted == m_beltshift) {
           m_solenoidToSet = (m_position-8) % 16;
         }
 
@@ -297,9 +546,9 @@ bool Knitter::calculatePixelAndSolenoid() {
         if (m_position <= (END_RIGHT - getStartOffset(Right))) {
           m_pixelToSet = m_position - getStartOffset(Right);
 
-          if (Regular == m_beltshift) {
+          if (Regular == m_beltshift || Lace_Regular == m_beltshift) {
             m_solenoidToSet = (m_position+8) % 16;
-          } else if (Shifted == m_beltshift) {
+          } else if (Shifted == m_beltshift || Lace_Shifted == m_beltshift) {
             m_solenoidToSet = m_position % 16;
           }
 
@@ -318,6 +567,62 @@ bool Knitter::calculatePixelAndSolenoid() {
   return true;
 }
 
+bool Knitter::getPixelValue(const Line_t* line,
+                            byte pixel,
+                            Direction_t direction) {
+  if (SourceLace == m_lineSource) {
+    // Transfers are selected from the lace chart
+    return m_laceLine.getNeedleState(pixel, m_carriage, direction);
+  }
+  // Find the right byte from the line array,
+  // then read the appropriate Pixel(/Bit) for the needle to set
+  return bitRead(line->data[pixel / 8], pixel % 8);
+}
+
+byte Knitter::getSolenoid(byte pixel, Direction_t direction) {
+  // Inverse of calculatePixelAndSolenoid()
+  byte _position;
+  bool _regular = (Regular == m_beltshift || Lace_Regular == m_beltshift);
+  if (Right == direction) {
+    _position = pixel + getStartOffset(Left) - ((L == m_carriage) ? 8 : 0);
+    return (_regular ? _position : _position - 8) % 16;
+  } else {
+    _position = pixel + getStartOffset(Right) + ((L == m_carriage) ? 16 : 0);
+    return (_regular ? _position + 8 : _position) % 16;
+  }
+}
+
+bool Knitter::isBeforeLine(const Line_t* line) {
+  return (Right == m_direction) ? (m_pixelToSet + 1 == line->startNeedle)
+                                : (m_pixelToSet == line->stopNeedle + 1);
+}
+
+void Knitter::armSolenoids() {
+  if (Regular != m_beltshift && Shifted != m_beltshift
+      && Lace_Regular != m_beltshift && Lace_Shifted != m_beltshift) {
+    m_solenoids.setSolenoid(m_solenoidToSet, true);
+    return;
+  }
+  Line_t* _line = m_lines.getCurrent();
+
+  // The first needles of the line use a solenoid each, set them all in
+  // one go before the carriage gets there. The 16th shares its solenoid
+  // with the needle passed right now, which must not be selected; it is
+  // set as usual when the carriage reaches it.
+  uint16 _state = 0xFFFF;
+  for (byte i = 0; i < 15; i++) {
+    int _pixel = (Right == m_direction) ? _line->startNeedle + i
+                                        : _line->stopNeedle - i;
+    if (_pixel < _line->startNeedle || _pixel > _line->stopNeedle) {
+      break;
+    }
+    if (!getPixelValue(_line, _pixel, m_direction)) {
+      bitClear(_state, getSolenoid(_pixel, m_direction));
+    }
+  }
+  m_solenoids.setSolenoids(_state);
+}
+
 byte Knitter::getStartOffset(Direction_t direction) {
   switch (direction) {
     case Left:
@@ -345,16 +650,215 @@ byte Knitter::getStartOffset(Direction_t direction) {
   }
 }
 
+void Knitter::nextLine() {
+  bool _available = m_lines.advance()
+                    || (generateLine() && m_lines.advance());
+
+  if (_available) {
+    if (m_row.waiting) {
+      m_row.waiting   = false;
+      m_row.lineWait += micros() - m_row.waitStart;
+    }
+    m_job.waitingForLine = false;
+    m_beeper.finishedLine();
+  } else {
+    m_job.waitingForLine = true;
+    if (!m_job.lineRequested) {
+      // request new Line from Host
+      reqLine(nextLineNumber());
+    }
+  }
+}
+
+bool Knitter::generateLine() {
+  // Lines produced on the device in place of the host
+  byte _line[LINEBUFFER_LEN];
+  bool _lastLine;
+
+  switch (m_lineSource) {
+    case SourceMotif:
+      _lastLine = m_motif.nextLine(m_startNeedle, m_stopNeedle, _line);
+      break;
+
+    case SourceColour:
+      if (!m_colourLine.hasPass()) {
+        // all passes out, next colour line is needed
+        return false;
+      }
+      _lastLine = m_colourLine.nextPass(m_startNeedle, m_stopNeedle, _line)
+                  && m_job.colourLastLine;
+      break;
+
+    case SourceStored:
+      _lastLine = m_patternStore.nextLine(_line);
+      break;
+
+    default:
+      return false;
+  }
+
+  m_lines.push(_line);
+  m_lines.getLast()->lastLine = _lastLine;
+  return true;
+}
+
+byte Knitter::nextLineNumber() {
+  if (SourceColour == m_lineSource) {
+    return m_job.colourLineNumber;
+  }
+  return m_lines.getNextNumber();
+}
+
+void Knitter::endWork() {
+  LOG1(LogEndWork, m_job.linesKnitted);
+  setState(s_ready);
+  m_solenoids.setSolenoids(0xFFFF);
+
+  if (!(startNextJob() & NextJobStarted)) {
+    m_beeper.endWork();
+    m_beeper.finishedLine();
+  }
+}
+
+/*! Start the first queued job that can be knitted, returns NextJob_t bits
+ *
+ *  indEndWork of the ended job goes out before the first reqLine of
+ *  the next one, telling the host what became of the queue.
+ */
+byte Knitter::startNextJob() {
+  Job_t _job;
+  byte  _nextJob = 0;
+  while (!(_nextJob & NextJobStarted) && m_jobs.pop(&_job)) {
+    _nextJob &= ~NextJobFromHost;
+    if (SourceStored == _job.lineSource && _job.hasHash
+        && !m_patternStore.select(_job.hash)) {
+      // Not stored, the host has to send the lines
+      _job.lineSource = SourceHost;
+      _nextJob |= NextJobFromHost;
+    }
+    if (SourceStored == _job.lineSource && !m_patternStore.rewind()) {
+      _nextJob |= NextJobSkipped;
+    } else {
+      _nextJob |= NextJobStarted;
+    }
+  }
+  indEndWork(_nextJob);
+
+  if (_nextJob & NextJobStarted) {
+    Direction_t _lineDoneDirection = m_job.lineDoneDirection;
+    // Cannot fail, the stored pattern was rewound above and queueJob()
+    // checked the other parameters
+    startOperation(_job.startNeedle, _job.stopNeedle,
+                   m_continuousReportingEnabled, _job.lineSource);
+    m_expectedCarriage = _job.carriage;
+    m_job.firstRun     = false;
+    // The panel starts with the turnaround after the previous one,
+    // its first line is needed right away
+    m_job.lineDoneDirection = _lineDoneDirection;
+    nextLine();
+  }
+  return _nextJob;
+}
+
 void Knitter::reqLine(byte lineNumber) {
-  uint8_t payload[2];
+  uint8_t payload[3];
   payload[0] = reqLine_msgid;
   payload[1] = lineNumber;
-  m_packetSerial->send(payload, 2);
+  // lines the host may send at once
+  payload[2] = (SourceHost == m_lineSource) ? m_lines.getFree() : 1;
+  m_txQueue->send(payload, 3, TxHigh);
+  LOG2(LogLineRequested, lineNumber, payload[2]);
+  TRACE_EVENT(TraceLineRequested, lineNumber, 0);
+
+  m_job.lineRequested = true;
+  if (!m_row.waiting) {
+    m_row.waiting   = true;
+    m_row.waitStart = micros();
+  }
+}
+
+void Knitter::indEndWork(byte nextJob) {
+  unsigned long _jobTime = millis() - m_job.startTime;
+
+  uint8_t payload[17];
+  payload[0]  = indEndWork_msgid;
+  payload[1]  = highByte(m_job.linesKnitted);
+  payload[2]  = lowByte(m_job.linesKnitted);
+  payload[3]  = m_jobs.getCount();
+  for (byte i = 0; i < 4; i++) {
+    byte _shift = 24 - 8 * i;
+    payload[4 + i]  = (_jobTime >> _shift) & 0xFF;
+    payload[8 + i]  = (m_job.lineWait >> _shift) & 0xFF;
+    payload[12 + i] = (m_job.needlesSelected >> _shift) & 0xFF;
+  }
+  payload[16] = nextJob;
+  m_txQueue->send(payload, 17, TxHigh);
+}
 
-  m_lineRequested = true;
+void Knitter::resetRow() {
+  m_row.startTime       = millis();
+  m_row.peakSpeed       = 0;
+  m_row.needles         = 0;
+  m_row.needlesSelected = 0;
+  m_row.lineWait        = 0;
 }
 
-void Knitter::indState(bool initState) {
+void Knitter::countNeedle(unsigned long edgeTime, bool pixelValue) {
+  byte _position = m_job.oldPosition;
+  if (0 == m_row.needles) {
+    m_row.firstEdge     = edgeTime;
+    m_row.firstPosition = _position;
+  } else if (edgeTime != m_row.lastEdge) {
+    // Speed since the previous needle, the fsm may have skipped some
+    byte _moved = abs((int)_position - (int)m_row.lastPosition);
+    unsigned long _speed = _moved * 1000000UL / (edgeTime - m_row.lastEdge);
+    m_row.peakSpeed = max(m_row.peakSpeed, (uint16)min(_speed, 0xFFFFUL));
+  }
+  m_row.lastEdge     = edgeTime;
+  m_row.lastPosition = _position;
+  if (m_row.needles < 0xFF) {
+    m_row.needles++;
+  }
+  if (!pixelValue) {
+    m_row.needlesSelected++;
+    m_job.needlesSelected++;
+  }
+}
+
+void Knitter::indRow() {
+  unsigned long _rowTime = millis() - m_row.startTime;
+  unsigned long _wait    = m_row.lineWait / 1000;
+  unsigned long _speed   = 0;
+  if (m_row.lastEdge != m_row.firstEdge) {
+    byte _moved = abs((int)m_row.lastPosition - (int)m_row.firstPosition);
+    _speed = _moved * 1000000UL / (m_row.lastEdge - m_row.firstEdge);
+  }
+  m_job.lineWait += _wait;
+
+  // Values beyond 16 bit saturate
+  _rowTime = min(_rowTime, 0xFFFFUL);
+  _wait    = min(_wait, 0xFFFFUL);
+  _speed   = min(_speed, 0xFFFFUL);
+
+  uint8_t payload[12];
+  payload[0]  = indRow_msgid;
+  payload[1]  = highByte(m_job.linesKnitted);
+  payload[2]  = lowByte(m_job.linesKnitted);
+  payload[3]  = highByte(_rowTime);
+  payload[4]  = lowByte(_rowTime);
+  payload[5]  = highByte(_speed);
+  payload[6]  = lowByte(_speed);
+  payload[7]  = highByte(m_row.peakSpeed);
+  payload[8]  = lowByte(m_row.peakSpeed);
+  payload[9]  = highByte(_wait);
+  payload[10] = lowByte(_wait);
+  payload[11] = m_row.needlesSelected;
+  // The job totals of indEndWork are never lost, row summaries may be
+  m_txQueue->send(payload, 12, TxLow);
+  resetRow();
+}
+
+void Knitter::indState(bool initState, TxPriority_t priority) {
   uint8_t payload[9];
   payload[0] = indState_msgid;
   payload[1] = (byte)initState;
@@ -370,5 +874,68 @@ void Knitter::indState(bool initState) {
   payload[6] = (byte)m_carriage;
   payload[7] = (byte)m_position;
   payload[8] = (byte)m_encoders.getDirection();
-  m_packetSerial->send(payload, 9);
+  m_txQueue->send(payload, 9, priority);
+}
+
+void Knitter::indStateDelta() {
+  uint16 _hallLeft  = m_encoders.getHallValue(Left);
+  uint16 _hallRight = m_encoders.getHallValue(Right);
+
+  // Lost low priority reports are made up for by a complete one
+  // every REPORT_FULL_EVERY calls, even while nothing changes
+  byte _fields = m_report.fields;
+  if (m_report.sinceFull < REPORT_FULL_EVERY) {
+    int _hallLeftChange  = (int)_hallLeft - (int)m_report.hallLeft;
+    int _hallRightChange = (int)_hallRight - (int)m_report.hallRight;
+    if (abs(_hallLeftChange) < REPORT_HALL_DEADBAND) {
+      _fields &= ~ReportHallLeft;
+    }
+    if (abs(_hallRightChange) < REPORT_HALL_DEADBAND) {
+      _fields &= ~ReportHallRight;
+    }
+    if (m_carriage == m_report.carriage) {
+      _fields &= ~ReportCarriage;
+    }
+    if (m_position == m_report.position) {
+      _fields &= ~ReportPosition;
+    }
+    if (m_direction == m_report.direction) {
+      _fields &= ~ReportDirection;
+    }
+    m_report.sinceFull++;
+    if (0 == _fields) {
+      return;
+    }
+  } else {
+    m_report.sinceFull = 0;
+  }
+
+  uint8_t payload[9];
+  byte    _size = 2;
+  payload[0] = indStateDelta_msgid;
+  payload[1] = _fields;
+  if (_fields & ReportHallLeft) {
+    m_report.hallLeft = _hallLeft;
+    payload[_size++]  = highByte(_hallLeft);
+    payload[_size++]  = lowByte(_hallLeft);
+  }
+  if (_fields & ReportHallRight) {
+    m_report.hallRight = _hallRight;
+    payload[_size++]   = highByte(_hallRight);
+    payload[_size++]   = lowByte(_hallRight);
+  }
+  if (_fields & ReportCarriage) {
+    m_report.carriage = m_carriage;
+    payload[_size++]  = (byte)m_carriage;
+  }
+  if (_fields & ReportPosition) {
+    m_report.position = m_position;
+    payload[_size++]  = m_position;
+  }
+  if (_fields & ReportDirection) {
+    m_report.direction = m_direction;
+    payload[_size++]   = (byte)m_direction;
+  }
+  m_report.time = millis();
+  m_txQueue->send(payload, _size, TxLow);
 }
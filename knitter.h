@@ -26,46 +26,159 @@ This file is part of AYAB.
 #include "./settings.h"
 #include "./debug.h"
 
-#include "./libraries/PacketSerial/src/PacketSerial.h"
+#include "./txqueue.h"
+#include "./linebuffer.h"
+#include "./motif.h"
+#include "./colourline.h"
+#include "./laceline.h"
+#include "./patternstore.h"
+#include "./jobqueue.h"
+#include "./histogram.h"
+#include "./trace.h"
 #include "./solenoids.h"
 #include "./encoders.h"
 #include "./beeper.h"
 
+/*!
+ *  State of the job being knitted, reset by startOperation()
+ */
+typedef struct JobContext {
+  bool        firstRun;           // start up delay and first line to come
+  byte        oldPosition;        // position the state last acted on
+  bool        workedOnLine;       // needles of the current line were set
+  bool        lineRequested;
+  bool        waitingForLine;     // current line knitted, next one needed
+  // Direction the previous line was finished in,
+  // the current one starts with the turnaround
+  Direction_t lineDoneDirection;
+  uint16      linesKnitted;
+  byte        colourLineNumber;
+  bool        colourLastLine;
+  // Totals for indEndWork
+  unsigned long startTime;        // ms
+  uint32_t    lineWait;           // ms, waiting for lines from the host
+  uint32_t    needlesSelected;
+} JobContext_t;
+
+/*!
+ *  Metrics of the row being knitted, reported with indRow
+ */
+typedef struct RowMetrics {
+  unsigned long startTime;        // ms, end of the previous row
+  unsigned long firstEdge;        // us, first needle of the row
+  unsigned long lastEdge;         // us, latest needle of the row
+  byte          firstPosition;
+  byte          lastPosition;
+  uint16        peakSpeed;        // needles/s
+  byte          needles;          // needles set
+  byte          needlesSelected;
+  bool          waiting;          // for the line requested at waitStart
+  unsigned long waitStart;        // us
+  unsigned long lineWait;         // us
+} RowMetrics_t;
+
+/*!
+ *  Continuous state reporting and the values last reported
+ */
+typedef struct ReportContext {
+  byte          fields;      // ReportField_t bits, none for indState
+  uint16        interval;    // ms, at least between two reports
+  unsigned long time;        // ms, last report
+  byte          sinceFull;   // delta reports since the last complete one
+  uint16        hallLeft;
+  uint16        hallRight;
+  Carriage_t    carriage;
+  byte          position;
+  Direction_t   direction;
+} ReportContext_t;
+
 class Knitter {
  public:
   Knitter();
-  Knitter(SLIPPacketSerial*);
+  Knitter(TxQueue*);
 
   void isr();
   void fsm();
+  /*! Housekeeping, run by the main loop besides fsm() */
+  void updateBeeper();
+  void updateHallValues();
+  void reportState();
+  /*! Fields and rate of the continuous state reports */
+  bool setReporting(byte fields, uint16 interval);
   bool startOperation(byte startNeedle,
                       byte stopNeedle,
                       bool continuousReportingEnabled,
-                      byte(*line));
+                      LineSource_t lineSource = SourceHost);
   bool startTest(void);
-  bool setNextLine(byte lineNumber);
+  /*! Job to start once the current one has ended */
+  bool queueJob(const Job_t* job);
+  void clearJobs();
+  byte getQueuedJobs();
+  /*! Motif for SourceMotif, to be set before startOperation() */
+  bool setMotif(const uint8_t* data, size_t size);
+  /*! Colour parameters for SourceColour, to be set before startOperation() */
+  bool setColours(const uint8_t* data, size_t size);
+  /*! Lace parameters for SourceLace, to be set before startOperation() */
+  bool setLace(const uint8_t* data, size_t size);
+  /*! Line to knit within the given needles, clamped to the job's range;
+   *  a window outside of it rejects the line
+   */
+  bool setNextLine(byte lineNumber, const byte* line,
+                   byte startNeedle = 0, byte stopNeedle = NUM_NEEDLES - 1);
+  bool setColourLine(byte lineNumber, const uint8_t* data, size_t size);
+  bool setLaceLine(byte lineNumber, const uint8_t* data, size_t size);
+  /*! Upload a chunk of the pattern for SourceStored */
+  bool   storePattern(uint16 offset, const uint8_t* data, size_t size);
+  uint16 getStoredBytes();
+  /*! Stored pattern for SourceStored, to be set before startOperation() */
+  bool   selectPattern(uint16 hash);
   void setLastLine();
+  /*! Ask the host again for a line it could not be decoded from */
+  void requestLineAgain();
+  /*! Most recently accepted line, reference for delta encoded lines */
+  const byte* getLastLine();
 
  private:
-  SLIPPacketSerial* m_packetSerial;
+#ifdef AYAB_HOST
+  // Microbenchmarks of the host build, host/bench.cpp
+  friend class KnitterBench;
+#endif
+
+  TxQueue*    m_txQueue;
   Solenoids   m_solenoids;
   Encoders    m_encoders;
   Beeper      m_beeper;
 
-  OpState_t m_opState;
-
-  bool m_lastLineFlag;
-  byte m_lastLinesCountdown;
+  typedef void (Knitter::*StateHandler_t)();
+  typedef struct StateEntry {
+    StateHandler_t handler;
+    byte           next;  // bits of the OpState_t reachable from here
+  } StateEntry_t;
+  static const StateEntry_t s_stateTable[s_test + 1];
+
+  OpState_t    m_opState;
+  JobContext_t m_job;
+  RowMetrics_t m_row;
+  ReportContext_t m_report;
+#ifdef DBG_NOMACHINE
+  bool         m_buttonState;
+#endif
 
   // Job Parameters
   byte m_startNeedle;
   byte m_stopNeedle;
   bool m_continuousReportingEnabled;
-  bool m_lineRequested;
-  byte m_currentLineNumber;
-  byte(*m_lineBuffer);
+  LineSource_t m_lineSource;
+  Carriage_t   m_expectedCarriage;
+  Motif        m_motif;
+  ColourLine   m_colourLine;
+  LaceLine     m_laceLine;
+  PatternStore m_patternStore;
+  JobQueue     m_jobs;
+  LineBuffer   m_lines;
 
   // current machine state
+  unsigned long m_edgeTime;  // us, latest encoder edge
   byte        m_position;
   Direction_t m_direction;
   Direction_t m_hallActive;
@@ -77,6 +190,13 @@ class Knitter {
   byte  m_pixelToSet;
 
 
+  bool isAllowed(OpState_t state);
+  bool setState(OpState_t state);
+  void resetJob();
+#ifdef DBG_NOMACHINE
+  bool buttonReleased();
+#endif
+
   void state_init();
   void state_ready();
   void state_operate();
@@ -84,9 +204,25 @@ class Knitter {
 
   bool calculatePixelAndSolenoid();
   byte getStartOffset(Direction_t);
-
+  bool getPixelValue(const Line_t* line, byte pixel, Direction_t direction);
+  byte getSolenoid(byte pixel, Direction_t direction);
+  /*! The carriage passes the needle right before the current line */
+  bool isBeforeLine(const Line_t* line);
+  void armSolenoids();
+
+  void nextLine();
+  bool generateLine();
+  byte nextLineNumber();
+  void endWork();
+  bool isSourceReady(LineSource_t lineSource);
+  byte startNextJob();
   void reqLine(byte lineNumber);
-  void indState(bool initState = false);
+  void indEndWork(byte nextJob);
+  void resetRow();
+  void countNeedle(unsigned long edgeTime, bool pixelValue);
+  void indRow();
+  void indState(bool initState = false, TxPriority_t priority = TxLow);
+  void indStateDelta();
 };
 
 #endif  // KNITTER_H_
@@ -0,0 +1,92 @@
+// laceline.cpp
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#include "Arduino.h"
+#include "./laceline.h"
+
+
+LaceLine::LaceLine() {
+  m_knitPasses = 2;
+  m_configured = false;
+  reset();
+}
+
+
+bool LaceLine::configure(const uint8_t* data, size_t size) {
+  if (size < 1 || 0 == data[0]) {
+    return false;
+  }
+  m_knitPasses = data[0];
+  m_configured = true;
+  return true;
+}
+
+
+bool LaceLine::isConfigured() {
+  return m_configured;
+}
+
+
+void LaceLine::reset() {
+  // No transfers until the first line is loaded
+  memset(m_data, 0, LACELINE_BYTES);
+  m_knits = 0;
+}
+
+
+bool LaceLine::load(const uint8_t* data, size_t size) {
+  if (LACELINE_BYTES != size) {
+    return false;
+  }
+  memcpy(m_data, data, LACELINE_BYTES);
+  m_knits = 0;
+  return true;
+}
+
+
+bool LaceLine::getNeedleState(byte needle,
+                              Carriage_t carriage,
+                              Direction_t direction) {
+  if (L != carriage || needle >= NUM_NEEDLES) {
+    // Knit carriage passes are plain
+    return true;
+  }
+
+  byte _flags = (m_data[needle / 4] >> ((needle % 4) * 2)) & 0x03;
+  switch (direction) {
+    case Right:
+      return !(_flags & LACE_TRANSFER_RIGHT);
+    case Left:
+      return !(_flags & LACE_TRANSFER_LEFT);
+    default:
+      return true;
+  }
+}
+
+
+bool LaceLine::finishPass(Carriage_t carriage) {
+  if (L == carriage) {
+    // Transfers do not count towards the knitted passes
+    return false;
+  }
+  m_knits++;
+  return m_knits >= m_knitPasses;
+}
@@ -0,0 +1,66 @@
+// laceline.h
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#ifndef LACELINE_H_
+#define LACELINE_H_
+
+#include "Arduino.h"
+#include "./settings.h"
+
+#define LACELINE_BYTES (NUM_NEEDLES / 4)
+
+#define LACE_TRANSFER_RIGHT 0x01  // transfer on the lace pass to the right
+#define LACE_TRANSFER_LEFT  0x02  // transfer on the lace pass to the left
+
+/*!
+ *  Line of a lace chart and the passes knitted from it
+ *
+ *  Every needle has 2 bits of LACE_TRANSFER_* flags, stored LSB first at
+ *  bits (n%4)*2 of byte n/4. Any number of lace carriage passes select
+ *  the needles flagged for their direction, the line is complete after
+ *  the configured number of plain passes with the knit carriage.
+ */
+class LaceLine {
+ public:
+  LaceLine();
+
+  /*! Knit carriage passes per chart line, as sent with reqStart */
+  bool configure(const uint8_t* data, size_t size);
+  /*! Parameters were sent since start */
+  bool isConfigured();
+  /*! Start over before the first line */
+  void reset();
+
+  bool load(const uint8_t* data, size_t size);
+
+  /*! Needle state of the current pass, true means not selected */
+  bool getNeedleState(byte needle, Carriage_t carriage, Direction_t direction);
+  /*! Count a finished pass, returns true once the line is complete */
+  bool finishPass(Carriage_t carriage);
+
+ private:
+  byte m_data[LACELINE_BYTES];
+  byte m_knitPasses;
+  bool m_configured;
+  byte m_knits;
+};
+
+#endif  // LACELINE_H_
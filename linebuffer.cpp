@@ -0,0 +1,103 @@
+// linebuffer.cpp
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#include "Arduino.h"
+#include "./linebuffer.h"
+
+
+LineBuffer::LineBuffer() {
+  reset(0, NUM_NEEDLES - 1);
+}
+
+
+void LineBuffer::reset(byte startNeedle, byte stopNeedle) {
+  m_startNeedle = startNeedle;
+  m_stopNeedle  = stopNeedle;
+  m_current     = 0;
+  m_pending     = 0;
+  m_nextNumber  = 0;
+
+  // Blank line, no needle selected until the first line arrives
+  Line_t* _line = &m_lines[m_current];
+  memset(_line->data, 0xFF, LINEBUFFER_LEN);
+  _line->startNeedle = startNeedle;
+  _line->stopNeedle  = stopNeedle;
+  _line->lastLine    = false;
+}
+
+
+bool LineBuffer::push(const byte* data) {
+  if (0 == getFree()) {
+    return false;
+  }
+
+  Line_t* _line = &m_lines[slot(m_pending + 1)];
+  memcpy(_line->data, data, LINEBUFFER_LEN);
+  _line->startNeedle = m_startNeedle;
+  _line->stopNeedle  = m_stopNeedle;
+  _line->lastLine    = false;
+
+  m_pending++;
+  m_nextNumber++;
+  return true;
+}
+
+
+bool LineBuffer::advance() {
+  if (0 == m_pending) {
+    return false;
+  }
+  m_current = slot(1);
+  m_pending--;
+  return true;
+}
+
+
+Line_t* LineBuffer::getCurrent() {
+  return &m_lines[m_current];
+}
+
+
+Line_t* LineBuffer::getLast() {
+  return &m_lines[slot(m_pending)];
+}
+
+
+byte LineBuffer::getNextNumber() {
+  return m_nextNumber;
+}
+
+
+byte LineBuffer::getFree() {
+  return LINEBUFFER_ROWS - 1 - m_pending;
+}
+
+
+/*
+ * PRIVATE METHODS
+ */
+byte LineBuffer::slot(byte offset) {
+  byte _slot = m_current + offset;
+  if (_slot >= LINEBUFFER_ROWS) {
+    _slot -= LINEBUFFER_ROWS;
+  }
+  return _slot;
+}
@@ -0,0 +1,72 @@
+// linebuffer.h
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#ifndef LINEBUFFER_H_
+#define LINEBUFFER_H_
+
+#include "Arduino.h"
+#include "./settings.h"
+
+#if LINEBUFFER_ROWS < 2
+  #error LINEBUFFER_ROWS has to be at least 2
+#endif
+
+typedef struct Line {
+  byte data[LINEBUFFER_LEN];  // needle states, inverted pixels
+  byte startNeedle;
+  byte stopNeedle;
+  bool lastLine;
+} Line_t;
+
+/*!
+ *  Ring of lines, the one being knitted followed by those received ahead
+ */
+class LineBuffer {
+ public:
+  LineBuffer();
+
+  /*! Start over with a blank current line, next line stored gets number 0 */
+  void    reset(byte startNeedle, byte stopNeedle);
+  /*! Store data as the next line, spanning the job's needle range */
+  bool    push(const byte* data);
+  /*! Make the oldest line received ahead the current one */
+  bool    advance();
+
+  Line_t* getCurrent();
+  /*! Most recently stored line */
+  Line_t* getLast();
+  /*! Line number the next stored line will get */
+  byte    getNextNumber();
+  /*! Number of lines that can still be stored */
+  byte    getFree();
+
+ private:
+  Line_t m_lines[LINEBUFFER_ROWS];
+  byte   m_current;
+  byte   m_pending;
+  byte   m_nextNumber;
+  byte   m_startNeedle;
+  byte   m_stopNeedle;
+
+  byte   slot(byte offset);
+};
+
+#endif  // LINEBUFFER_H_
@@ -0,0 +1,111 @@
+// linecodec.cpp
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#include "Arduino.h"
+#include "./linecodec.h"
+
+
+bool LineCodec::decodeRaw(const uint8_t* data, size_t size, byte* line) {
+  if (LINEBUFFER_LEN != size) {
+    return false;
+  }
+
+  for (int i = 0; i < LINEBUFFER_LEN; i++) {
+    // Values have to be inverted because of needle states
+    line[i] = ~data[i];
+  }
+  return true;
+}
+
+
+bool LineCodec::decodeXor(const uint8_t* data, size_t size, byte* line) {
+  if (size % 2) {
+    return false;
+  }
+  for (size_t i = 0; i < size; i += 2) {
+    if (data[i] >= LINEBUFFER_LEN) {
+      return false;
+    }
+  }
+
+  // Inversion and XOR commute, so the mask applies as is
+  for (size_t i = 0; i < size; i += 2) {
+    line[data[i]] ^= data[i+1];
+  }
+  return true;
+}
+
+
+bool LineCodec::decodeRle(const uint8_t* data, size_t size, byte* line) {
+  if (0 == size || 0 == size % 2) {
+    return false;
+  }
+
+  int _end = data[0];
+  for (size_t i = 1; i < size; i += 2) {
+    _end += data[i];
+  }
+  if (_end > LINEBUFFER_LEN) {
+    return false;
+  }
+
+  byte _index = 0;
+  while (_index < data[0]) {
+    line[_index++] = 0xFF;
+  }
+  for (size_t i = 1; i < size; i += 2) {
+    for (byte n = 0; n < data[i]; n++) {
+      line[_index++] = ~data[i+1];
+    }
+  }
+  while (_index < LINEBUFFER_LEN) {
+    line[_index++] = 0xFF;
+  }
+  return true;
+}
+
+
+bool LineCodec::decodeRange(const uint8_t* data, size_t size, byte* line) {
+  if (size < 3) {
+    return false;
+  }
+
+  byte _startNeedle = data[0];
+  byte _stopNeedle  = data[1];
+  if (_startNeedle > _stopNeedle || _stopNeedle >= NUM_NEEDLES) {
+    return false;
+  }
+
+  byte _firstByte = _startNeedle / 8;
+  byte _lastByte  = _stopNeedle / 8;
+  if (size - 2 != (size_t)(_lastByte - _firstByte + 1)) {
+    return false;
+  }
+
+  for (byte i = 0; i < LINEBUFFER_LEN; i++) {
+    if (i < _firstByte || i > _lastByte) {
+      line[i] = 0xFF;
+    } else {
+      line[i] = ~data[2 + i - _firstByte];
+    }
+  }
+  return true;
+}
@@ -0,0 +1,58 @@
+// linecodec.h
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#ifndef LINECODEC_H_
+#define LINECODEC_H_
+
+#include "Arduino.h"
+#include "./settings.h"
+
+/*!
+ *  Decoders for the compressed cnfLine variants
+ *
+ *  All decoders write into a line of LINEBUFFER_LEN bytes in needle
+ *  state order, i.e. inverted with respect to the pixels sent by the host.
+ *  Malformed data is rejected before anything is written.
+ */
+class LineCodec {
+ public:
+  /*! Plain bitmap of LINEBUFFER_LEN bytes */
+  static bool decodeRaw(const uint8_t* data, size_t size, byte* line);
+
+  /*! XOR delta against the previous line held in line,
+   *  pairs of (byte index, xor mask)
+   */
+  static bool decodeXor(const uint8_t* data, size_t size, byte* line);
+
+  /*! Byte run length encoding of the active needle range,
+   *  first byte index followed by pairs of (count, value).
+   *  Bytes outside the encoded range are cleared.
+   */
+  static bool decodeRle(const uint8_t* data, size_t size, byte* line);
+
+  /*! Needle window of the line,
+   *  start and stop needle followed by the bytes covering them.
+   *  Bytes outside the window are cleared.
+   */
+  static bool decodeRange(const uint8_t* data, size_t size, byte* line);
+};
+
+#endif  // LINECODEC_H_
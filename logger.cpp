@@ -0,0 +1,68 @@
+// logger.cpp
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#include "Arduino.h"
+#include "./logger.h"
+
+Logger logger;
+
+
+Logger::Logger() {
+  m_ring.init(m_buffer, LOGGER_SIZE);
+  m_dropped = 0;
+}
+
+
+void Logger::log(byte token, byte args, uint16 a, uint16 b) {
+  uint8_t _entry[5];
+  _entry[0] = token;
+  _entry[1] = highByte(a);
+  _entry[2] = lowByte(a);
+  _entry[3] = highByte(b);
+  _entry[4] = lowByte(b);
+
+  noInterrupts();
+  if (!m_ring.push(_entry, 1 + 2 * args) && m_dropped < 0xFF) {
+    m_dropped++;
+  }
+  interrupts();
+}
+
+
+void Logger::flush(TxQueue* txQueue) {
+  uint8_t payload[TXQUEUE_MAX_PAYLOAD];
+  byte    _size = 2;
+
+  noInterrupts();
+  while (!m_ring.isEmpty()
+         && _size + m_ring.peekSize() <= TXQUEUE_MAX_PAYLOAD) {
+    _size += m_ring.peek(&payload[_size]);
+    m_ring.pop();
+  }
+  payload[0] = debug_msgid;
+  payload[1] = m_dropped;
+  m_dropped  = 0;
+  interrupts();
+
+  if (_size > 2 || payload[1]) {
+    txQueue->send(payload, _size, TxLow);
+  }
+}
@@ -0,0 +1,53 @@
+// logger.h
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#ifndef LOGGER_H_
+#define LOGGER_H_
+
+#include "Arduino.h"
+#include "./settings.h"
+#include "./txqueue.h"
+
+/*!
+ *  Deferred formatting logger, see LOG_TOKENS in debug.h
+ *
+ *  Entries are a token and up to two 16 bit arguments, kept in RAM
+ *  until flush() sends them as debug_msgid packets of low priority:
+ *  id, entries dropped since the last packet, then entries of
+ *  token, arguments (2 each, as many as the token's text has).
+ */
+class Logger {
+ public:
+  Logger();
+
+  /*! Safe to call from an ISR */
+  void log(byte token, byte args, uint16 a, uint16 b);
+  void flush(TxQueue* txQueue);
+
+ private:
+  TxRing m_ring;
+  byte   m_buffer[LOGGER_SIZE];
+  byte   m_dropped;
+};
+
+extern Logger logger;
+
+#endif  // LOGGER_H_
@@ -0,0 +1,111 @@
+// motif.cpp
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#include "Arduino.h"
+#include "./motif.h"
+
+
+Motif::Motif() {
+  m_width    = 0;
+  m_height   = 0;
+  m_vRepeats = 0;
+  m_line     = 0;
+}
+
+
+bool Motif::load(const uint8_t* data, size_t size) {
+  if (size < 7) {
+    return false;
+  }
+
+  byte _width    = data[0];
+  byte _height   = data[1];
+  byte _rowBytes = (_width + 7) / 8;
+  if (0 == _width || 0 == _height || 0 == data[3]
+      || size - 7 != (size_t)_rowBytes * _height
+      || size - 7 > MOTIF_MAX_BYTES) {
+    return false;
+  }
+
+  m_width    = _width;
+  m_height   = _height;
+  m_rowBytes = _rowBytes;
+  m_hRepeats = data[2];
+  m_vRepeats = data[3];
+  m_xOffset  = data[4] % _width;
+  m_yOffset  = data[5] % _height;
+  m_flags    = data[6];
+  memcpy(m_bits, &data[7], size - 7);
+
+  reset();
+  return true;
+}
+
+
+bool Motif::isLoaded() {
+  return 0 != m_height;
+}
+
+
+void Motif::reset() {
+  m_line = 0;
+}
+
+
+bool Motif::nextLine(byte startNeedle, byte stopNeedle, byte* line) {
+  // Motif row of this line
+  uint16 _row     = m_line + m_yOffset;
+  uint16 _vRepeat = _row / m_height;
+  byte   _y       = _row % m_height;
+  if ((m_flags & MOTIF_MIRROR_V) && (_vRepeat & 1)) {
+    _y = m_height - 1 - _y;
+  }
+  const byte* _bits = &m_bits[_y * m_rowBytes];
+
+  memset(line, 0xFF, LINEBUFFER_LEN);
+
+  // Walk the needles once, keeping track of the motif column,
+  // divisions are too slow to do per needle
+  byte _x       = m_xOffset;
+  byte _hRepeat = 0;
+  for (int needle = startNeedle; needle <= stopNeedle; needle++) {
+    if (m_hRepeats && _hRepeat >= m_hRepeats) {
+      break;
+    }
+
+    byte _column = _x;
+    if ((m_flags & MOTIF_MIRROR_H) && (_hRepeat & 1)) {
+      _column = m_width - 1 - _x;
+    }
+    if (bitRead(_bits[_column / 8], _column % 8)) {
+      // Inverted because of needle states
+      bitClear(line[needle / 8], needle % 8);
+    }
+
+    if (++_x >= m_width) {
+      _x = 0;
+      _hRepeat++;
+    }
+  }
+
+  m_line++;
+  return m_line >= (uint16)m_vRepeats * m_height;
+}
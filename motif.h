@@ -0,0 +1,67 @@
+// motif.h
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#ifndef MOTIF_H_
+#define MOTIF_H_
+
+#include "Arduino.h"
+#include "./settings.h"
+
+#define MOTIF_MIRROR_H 0x01  // mirror every other horizontal repeat
+#define MOTIF_MIRROR_V 0x02  // mirror every other vertical repeat
+
+/*!
+ *  Pattern repeat engine, tiles a small motif over the needle range
+ *
+ *  Motif layout as sent with reqStart:
+ *  width, height, horizontal repeats (0: fill the range), vertical repeats,
+ *  x offset, y offset, flags, height rows of (width+7)/8 bytes.
+ *  Pixel x of a row is bit x%8 of byte x/8, like in a line.
+ */
+class Motif {
+ public:
+  Motif();
+
+  bool load(const uint8_t* data, size_t size);
+  /*! A motif was loaded, nextLine() needs one */
+  bool isLoaded();
+  /*! Start over at the first line */
+  void reset();
+  /*! Generate the next line in needle state order,
+   *  returns true for the last line of the last vertical repeat
+   */
+  bool nextLine(byte startNeedle, byte stopNeedle, byte* line);
+
+ private:
+  byte   m_bits[MOTIF_MAX_BYTES];
+  byte   m_width;
+  byte   m_height;
+  byte   m_rowBytes;
+  byte   m_hRepeats;
+  byte   m_vRepeats;
+  byte   m_xOffset;
+  byte   m_yOffset;
+  byte   m_flags;
+
+  uint16 m_line;
+};
+
+#endif  // MOTIF_H_
@@ -0,0 +1,323 @@
+// patternstore.cpp
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#include "Arduino.h"
+#include "./patternstore.h"
+#include "./debug.h"
+
+#ifdef PATTERNSTORE_SPIFLASH
+  #include <SPI.h>
+
+  #define SPIFLASH_WRITE_ENABLE 0x06
+  #define SPIFLASH_READ_STATUS  0x05
+  #define SPIFLASH_SECTOR_ERASE 0x20
+  #define SPIFLASH_PAGE_PROGRAM 0x02
+  #define SPIFLASH_READ         0x03
+#else
+  #include <EEPROM.h>
+#endif
+
+
+PatternStore::PatternStore() {
+  m_uploadSlot  = 0;
+  m_received    = 0;
+  m_length      = 0;
+  m_slot        = 0;
+  m_lines       = 0;
+  m_line        = 0;
+  m_runLeft     = 0;
+}
+
+
+void PatternStore::init() {
+#ifdef PATTERNSTORE_SPIFLASH
+  pinMode(SPIFLASH_CS_PIN, OUTPUT);
+  digitalWrite(SPIFLASH_CS_PIN, HIGH);
+  SPI.begin();
+  m_erasedEnd = 0;
+#endif
+}
+
+
+bool PatternStore::write(uint16 offset, const uint8_t* data, size_t size) {
+  if (0 == offset) {
+    // Begin of a new upload, the replaced pattern is gone from here on
+    m_received = 0;
+    if (size < PATTERNSTORE_HEADER || PATTERNSTORE_MAGIC != data[0]) {
+      return false;
+    }
+    m_length = ((uint16)data[1] << 8) | data[2];
+    if (m_length < PATTERNSTORE_HEADER
+        || m_length > PATTERNSTORE_SLOT_SIZE) {
+      return false;
+    }
+    m_uploadSlot = uploadSlot(((uint16)data[5] << 8) | data[6]);
+#ifdef PATTERNSTORE_SPIFLASH
+    m_erasedEnd = slotAddress(m_uploadSlot);
+#endif
+    byte _invalid = 0xFF;
+    writeBytes(slotAddress(m_uploadSlot), &_invalid, 1);
+    m_received = 1;
+    offset     = 1;
+    data++;
+    size--;
+  }
+
+  // Chunks have to arrive in order and within the container
+  if (0 == m_received || offset != m_received
+      || size > (size_t)(m_length - m_received)) {
+    LOG1(LogPatternRejected, offset);
+    return false;
+  }
+  writeBytes(slotAddress(m_uploadSlot) + offset, data, size);
+  m_received += size;
+
+  if (m_received == m_length) {
+    if (!verify()) {
+      LOG1(LogPatternRejected, offset);
+      m_received = 0;
+      return false;
+    }
+    byte _previous = newestSlot();
+    byte _magic    = PATTERNSTORE_MAGIC;
+    writeBytes(slotAddress(m_uploadSlot), &_magic, 1);
+    if (_previous < PATTERNSTORE_SLOTS && _previous != m_uploadSlot) {
+      _magic = PATTERNSTORE_MAGIC_OLD;
+      programBytes(slotAddress(_previous), &_magic, 1);
+    }
+    // Knit the new pattern unless another one is selected
+    m_slot = m_uploadSlot;
+    LOG1(LogPatternStored, m_length);
+  }
+  return true;
+}
+
+
+uint16 PatternStore::getReceived() {
+  return m_received;
+}
+
+
+bool PatternStore::select(uint16 hash) {
+  for (byte slot = 0; slot < PATTERNSTORE_SLOTS; slot++) {
+    if (isValid(slot) && hash == readWord(slotAddress(slot) + 5)) {
+      m_slot = slot;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+bool PatternStore::rewind() {
+  if (!isValid(m_slot)) {
+    return false;
+  }
+  m_lines   = readWord(slotAddress(m_slot) + 3);
+  m_line    = 0;
+  m_address = slotAddress(m_slot) + PATTERNSTORE_HEADER;
+  m_runLeft = 0;
+  return m_lines > 0;
+}
+
+
+bool PatternStore::nextLine(byte* line) {
+  for (byte i = 0; i < LINEBUFFER_LEN; i++) {
+    if (0 == m_runLeft) {
+      m_runLeft  = readByte(m_address++);
+      m_runValue = readByte(m_address++);
+    }
+    // Values have to be inverted because of needle states
+    line[i] = ~m_runValue;
+    m_runLeft--;
+  }
+
+  m_line++;
+  return m_line >= m_lines;
+}
+
+
+/*
+ * PRIVATE METHODS
+ */
+bool PatternStore::isValid(byte slot) {
+  byte _magic = readByte(slotAddress(slot));
+  return PATTERNSTORE_MAGIC == _magic || PATTERNSTORE_MAGIC_OLD == _magic;
+}
+
+
+byte PatternStore::newestSlot() {
+  for (byte slot = 0; slot < PATTERNSTORE_SLOTS; slot++) {
+    if (PATTERNSTORE_MAGIC == readByte(slotAddress(slot))) {
+      return slot;
+    }
+  }
+  return PATTERNSTORE_SLOTS;
+}
+
+
+byte PatternStore::uploadSlot(uint16 hash) {
+  // Same pattern again, a free slot or else the next one in turn
+  for (byte slot = 0; slot < PATTERNSTORE_SLOTS; slot++) {
+    if (isValid(slot) && hash == readWord(slotAddress(slot) + 5)) {
+      return slot;
+    }
+  }
+  for (byte slot = 0; slot < PATTERNSTORE_SLOTS; slot++) {
+    if (!isValid(slot)) {
+      return slot;
+    }
+  }
+  // The slot after the newest pattern holds the oldest one
+  return (newestSlot() + 1) % PATTERNSTORE_SLOTS;
+}
+
+
+bool PatternStore::verify() {
+  // Runs have to cover all lines exactly, nextLine() relies on it
+  uint32_t _base   = slotAddress(m_uploadSlot);
+  uint32_t _needed = (uint32_t)readWord(_base + 3) * LINEBUFFER_LEN;
+  uint32_t _pixels = 0;
+  uint16_t _crc    = 0xFFFF;
+
+  if ((m_length - PATTERNSTORE_HEADER) % 2) {
+    return false;
+  }
+  for (uint16 offset = PATTERNSTORE_HEADER; offset < m_length; offset++) {
+    byte _value = readByte(_base + offset);
+    if (0 == (offset - PATTERNSTORE_HEADER) % 2) {
+      if (0 == _value) {
+        return false;
+      }
+      _pixels += _value;
+    }
+
+    _crc ^= (uint16_t)_value << 8;
+    for (byte bit = 0; bit < 8; bit++) {
+      if (_crc & 0x8000) {
+        _crc = (_crc << 1) ^ 0x1021;
+      } else {
+        _crc <<= 1;
+      }
+    }
+  }
+  return _pixels == _needed && _crc == readWord(_base + 5);
+}
+
+
+uint32_t PatternStore::slotAddress(byte slot) {
+  return (uint32_t)slot * PATTERNSTORE_SLOT_SIZE;
+}
+
+
+uint16 PatternStore::readWord(uint32_t address) {
+  return ((uint16)readByte(address) << 8) | readByte(address + 1);
+}
+
+
+#ifdef PATTERNSTORE_SPIFLASH
+static void spiflashCommand(byte command, uint32_t address) {
+  SPI.transfer(command);
+  SPI.transfer((address >> 16) & 0xFF);
+  SPI.transfer((address >> 8) & 0xFF);
+  SPI.transfer(address & 0xFF);
+}
+
+static void spiflashWriteEnable() {
+  digitalWrite(SPIFLASH_CS_PIN, LOW);
+  SPI.transfer(SPIFLASH_WRITE_ENABLE);
+  digitalWrite(SPIFLASH_CS_PIN, HIGH);
+}
+
+static void spiflashWait() {
+  digitalWrite(SPIFLASH_CS_PIN, LOW);
+  SPI.transfer(SPIFLASH_READ_STATUS);
+  while (SPI.transfer(0) & 0x01) {
+    // busy
+  }
+  digitalWrite(SPIFLASH_CS_PIN, HIGH);
+}
+#endif
+
+
+byte PatternStore::readByte(uint32_t address) {
+#ifdef PATTERNSTORE_SPIFLASH
+  digitalWrite(SPIFLASH_CS_PIN, LOW);
+  spiflashCommand(SPIFLASH_READ, address);
+  byte _value = SPI.transfer(0);
+  digitalWrite(SPIFLASH_CS_PIN, HIGH);
+  return _value;
+#else
+  return EEPROM.read(address);
+#endif
+}
+
+
+void PatternStore::writeBytes(uint32_t address,
+                              const uint8_t* data, size_t size) {
+#ifdef PATTERNSTORE_SPIFLASH
+  // Sectors are erased as the upload reaches them
+  while (m_erasedEnd < address + size) {
+    spiflashWriteEnable();
+    digitalWrite(SPIFLASH_CS_PIN, LOW);
+    spiflashCommand(SPIFLASH_SECTOR_ERASE, m_erasedEnd);
+    digitalWrite(SPIFLASH_CS_PIN, HIGH);
+    spiflashWait();
+    m_erasedEnd += SPIFLASH_SECTOR;
+  }
+#endif
+  programBytes(address, data, size);
+}
+
+
+void PatternStore::programBytes(uint32_t address,
+                                const uint8_t* data, size_t size) {
+#ifdef PATTERNSTORE_SPIFLASH
+  // Bits can only be cleared, the sectors have to be erased before
+  while (size > 0) {
+    // A program operation must not cross a page boundary
+    size_t _chunk = SPIFLASH_PAGE - (address % SPIFLASH_PAGE);
+    if (_chunk > size) {
+      _chunk = size;
+    }
+    spiflashWriteEnable();
+    digitalWrite(SPIFLASH_CS_PIN, LOW);
+    spiflashCommand(SPIFLASH_PAGE_PROGRAM, address);
+    for (size_t i = 0; i < _chunk; i++) {
+      SPI.transfer(data[i]);
+    }
+    digitalWrite(SPIFLASH_CS_PIN, HIGH);
+    spiflashWait();
+
+    address += _chunk;
+    data    += _chunk;
+    size    -= _chunk;
+  }
+#else
+  for (size_t i = 0; i < size; i++) {
+    // Only changed cells are written, EEPROM wears out;
+    // the 1.0.6 EEPROM library has no update()
+    if (EEPROM.read(address + i) != data[i]) {
+      EEPROM.write(address + i, data[i]);
+    }
+  }
+#endif
+}
@@ -0,0 +1,115 @@
+// patternstore.h
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#ifndef PATTERNSTORE_H_
+#define PATTERNSTORE_H_
+
+#include "Arduino.h"
+#include "./settings.h"
+
+#define PATTERNSTORE_MAGIC     0xA7
+#define PATTERNSTORE_MAGIC_OLD 0x27  // bit 7 cleared, stored before the newest
+#define PATTERNSTORE_HEADER 7  // magic, length (2), lines (2), hash (2)
+
+#ifdef PATTERNSTORE_SPIFLASH
+  #define PATTERNSTORE_SLOTS     8
+  #define PATTERNSTORE_SLOT_SIZE 8192UL  // bytes, whole sectors
+  #define SPIFLASH_SECTOR        4096UL  // bytes, smallest erasable unit
+  #define SPIFLASH_PAGE          256     // bytes, largest programmable unit
+#else
+  #define PATTERNSTORE_SLOTS     2
+  #define PATTERNSTORE_SLOT_SIZE ((E2END + 1UL) / PATTERNSTORE_SLOTS)
+#endif
+
+/*!
+ *  Pattern kept in non-volatile memory for knitting without the host
+ *
+ *  Container layout, multi-byte values big endian:
+ *  magic, container length including this header (2), number of lines (2),
+ *  hash (2), then (count, value) runs of pixel bytes as sent by the host,
+ *  covering lines * LINEBUFFER_LEN bytes. Runs may span lines.
+ *  The hash is the CRC-16/CCITT of the runs, like the one of RowCache.
+ *
+ *  The storage holds PATTERNSTORE_SLOTS containers, the host picks a
+ *  stored pattern by its hash. The container is uploaded in chunks at
+ *  increasing offsets. The magic is written once the whole container has
+ *  arrived and checked out, so an interrupted upload never leaves a
+ *  pattern that looks valid. Lines are decoded one at a time while
+ *  knitting, the image is never held in RAM.
+ *
+ *  Only the most recently stored pattern keeps PATTERNSTORE_MAGIC, the
+ *  one before gets PATTERNSTORE_MAGIC_OLD, which flash can program
+ *  without an erase. When all slots are taken, the slot after the newest
+ *  pattern is replaced, so slots are reused in turn across restarts.
+ */
+class PatternStore {
+ public:
+  PatternStore();
+
+  void init();
+
+  /*! Store a chunk of the container, offset 0 starts a new upload */
+  bool   write(uint16 offset, const uint8_t* data, size_t size);
+  /*! Bytes of the current upload received so far */
+  uint16 getReceived();
+  /*! Pick the stored pattern with the given hash for knitting */
+  bool   select(uint16 hash);
+
+  /*! Start decoding the first line of the picked pattern,
+   *  false if there is no pattern
+   */
+  bool rewind();
+  /*! Decode the next line in needle state order,
+   *  returns true for the last line
+   */
+  bool nextLine(byte* line);
+
+ private:
+  // Upload
+  byte   m_uploadSlot;
+  uint16 m_received;
+  uint16 m_length;
+#ifdef PATTERNSTORE_SPIFLASH
+  // Sectors below are erased for the current upload
+  uint32_t m_erasedEnd;
+#endif
+
+  // Decoder position
+  byte     m_slot;
+  uint32_t m_address;
+  uint16   m_lines;
+  uint16   m_line;
+  byte     m_runLeft;
+  byte     m_runValue;
+
+  bool   isValid(byte slot);
+  byte   newestSlot();
+  byte   uploadSlot(uint16 hash);
+  bool   verify();
+
+  uint32_t slotAddress(byte slot);
+  uint16   readWord(uint32_t address);
+  byte     readByte(uint32_t address);
+  void     writeBytes(uint32_t address, const uint8_t* data, size_t size);
+  void     programBytes(uint32_t address, const uint8_t* data, size_t size);
+};
+
+#endif  // PATTERNSTORE_H_
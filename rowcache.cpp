@@ -0,0 +1,137 @@
+// rowcache.cpp
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#include "Arduino.h"
+#include "./rowcache.h"
+
+
+RowCache::RowCache() {
+  m_used = 0;
+  resetStats();
+}
+
+
+uint16 RowCache::hash(const byte* line) {
+  uint16_t _crc = 0xFFFF;
+  for (byte i = 0; i < LINEBUFFER_LEN; i++) {
+    // Lines are stored inverted, hash the pixels as sent by the host
+    _crc ^= (uint16_t)(byte)~line[i] << 8;
+    for (byte bit = 0; bit < 8; bit++) {
+      if (_crc & 0x8000) {
+        _crc = (_crc << 1) ^ 0x1021;
+      } else {
+        _crc <<= 1;
+      }
+    }
+  }
+  return _crc;
+}
+
+
+void RowCache::insert(const byte* line, byte lineNumber,
+                      byte startNeedle, byte stopNeedle) {
+  uint16 _hash = hash(line);
+
+  byte _slot = 0;
+  for (; _slot < m_used; _slot++) {
+    CachedRow_t* _row = &m_rows[_slot];
+    if (_hash == _row->hash
+        && startNeedle == _row->startNeedle && stopNeedle == _row->stopNeedle
+        && 0 == memcmp(_row->data, line, LINEBUFFER_LEN)) {
+      // Addressed by its latest line number from now on
+      _row->lineNumber = lineNumber;
+      touch(_slot);
+      return;
+    }
+  }
+
+  if (m_used < ROWCACHE_SLOTS) {
+    _slot = m_used++;
+    m_ages[_slot] = ROWCACHE_SLOTS - 1;
+  } else {
+    // Replace the least recently used line
+    for (_slot = 0; _slot < ROWCACHE_SLOTS - 1; _slot++) {
+      if (ROWCACHE_SLOTS - 1 == m_ages[_slot]) {
+        break;
+      }
+    }
+  }
+
+  CachedRow_t* _row = &m_rows[_slot];
+  memcpy(_row->data, line, LINEBUFFER_LEN);
+  _row->hash        = _hash;
+  _row->lineNumber  = lineNumber;
+  _row->startNeedle = startNeedle;
+  _row->stopNeedle  = stopNeedle;
+  touch(_slot);
+}
+
+
+const CachedRow_t* RowCache::lookup(byte lineNumber, uint16 hash) {
+  for (byte i = 0; i < m_used; i++) {
+    if (lineNumber == m_rows[i].lineNumber && hash == m_rows[i].hash) {
+      touch(i);
+      if (m_hits < 0xFFFF) {
+        m_hits++;
+      }
+      return &m_rows[i];
+    }
+  }
+
+  if (m_misses < 0xFFFF) {
+    m_misses++;
+  }
+  return NULL;
+}
+
+
+uint16 RowCache::getHits() {
+  return m_hits;
+}
+
+
+uint16 RowCache::getMisses() {
+  return m_misses;
+}
+
+
+byte RowCache::getUsed() {
+  return m_used;
+}
+
+
+void RowCache::resetStats() {
+  m_hits   = 0;
+  m_misses = 0;
+}
+
+
+/*
+ * PRIVATE METHODS
+ */
+void RowCache::touch(byte slot) {
+  for (byte i = 0; i < m_used; i++) {
+    if (m_ages[i] < m_ages[slot]) {
+      m_ages[i]++;
+    }
+  }
+  m_ages[slot] = 0;
+}
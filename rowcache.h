@@ -0,0 +1,73 @@
+// rowcache.h
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#ifndef ROWCACHE_H_
+#define ROWCACHE_H_
+
+#include "Arduino.h"
+#include "./settings.h"
+
+typedef struct CachedRow {
+  byte   data[LINEBUFFER_LEN];  // needle states, inverted pixels
+  uint16 hash;
+  byte   lineNumber;   // line number it was last accepted as
+  byte   startNeedle;  // needle window it was sent with
+  byte   stopNeedle;
+} CachedRow_t;
+
+/*!
+ *  Least recently used cache of accepted lines
+ *
+ *  The host addresses a cached row with cnfLineCached by the line number
+ *  it was last accepted as, which the host assigned, together with the
+ *  CRC-16/CCITT (polynomial 0x1021, initial value 0xFFFF) of its
+ *  LINEBUFFER_LEN pixel bytes as sent by the host. Both have to match,
+ *  so a hash collision alone never picks another row.
+ */
+class RowCache {
+ public:
+  RowCache();
+
+  static uint16 hash(const byte* line);
+
+  /*! Store a line or mark it as recently used if already present */
+  void insert(const byte* line, byte lineNumber,
+              byte startNeedle, byte stopNeedle);
+  /*! Cached row or NULL, counts hits and misses */
+  const CachedRow_t* lookup(byte lineNumber, uint16 hash);
+
+  uint16 getHits();
+  uint16 getMisses();
+  byte   getUsed();
+  void   resetStats();
+
+ private:
+  CachedRow_t m_rows[ROWCACHE_SLOTS];
+  byte        m_ages[ROWCACHE_SLOTS];  // 0 is the most recently used
+  byte   m_used;
+
+  uint16 m_hits;
+  uint16 m_misses;
+
+  void touch(byte slot);
+};
+
+#endif  // ROWCACHE_H_
@@ -0,0 +1,196 @@
+// scheduler.cpp
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#include "Arduino.h"
+#include <avr/sleep.h>
+#include "./scheduler.h"
+
+
+Scheduler::Scheduler() {
+  m_count = 0;
+  m_slept = false;
+  resetSleepStats();
+}
+
+
+bool Scheduler::add(void (*run)(),
+                    unsigned long period,
+                    unsigned long deadline,
+                    unsigned long budget) {
+  if (m_count >= SCHEDULER_TASKS) {
+    return false;
+  }
+
+  Task_t* _task = &m_tasks[m_count++];
+  _task->run         = run;
+  _task->period      = period;
+  _task->deadline    = deadline;
+  _task->budget      = budget;
+  _task->release     = micros();
+  _task->triggered   = false;
+  _task->triggerTime = 0;
+  _task->misses      = 0;
+  _task->overruns    = 0;
+  return true;
+}
+
+
+void Scheduler::trigger(TaskId_t task) {
+  if (task < m_count && !m_tasks[task].triggered) {
+    m_tasks[task].triggerTime = micros();
+    m_tasks[task].triggered   = true;
+  }
+}
+
+
+bool Scheduler::update() {
+  unsigned long _now = micros();
+  bool _slept = m_slept;
+  m_slept = false;
+
+  for (byte i = 0; i < m_count; i++) {
+    Task_t* _task = &m_tasks[i];
+    unsigned long _release;
+
+    if (_task->triggered) {
+      noInterrupts();
+      _release          = _task->triggerTime;
+      _task->triggered  = false;
+      interrupts();
+      // The trigger may have come after _now was taken,
+      // time the latency against a later reading
+      _now = micros();
+      // Periodic releases go on from here
+      _task->release = _now;
+
+      uint16 _latency = min(_now - _release, 0xFFFFUL);
+      if (_slept) {
+        m_wakeups++;
+        m_wakeLatencySum += _latency;
+        m_wakeLatencyMax  = max(m_wakeLatencyMax, _latency);
+      } else {
+        m_latencyMax = max(m_latencyMax, _latency);
+      }
+    } else if (_task->period && _now - _task->release >= _task->period) {
+      _release = _task->release + _task->period;
+      // After whole periods went by, do not catch up on them in a burst
+      _task->release = (_now - _release >= _task->period) ? _now : _release;
+    } else {
+      continue;
+    }
+
+    unsigned long _start = micros();
+    _task->run();
+    unsigned long _end = micros();
+
+    if (_end - _start > _task->budget) {
+      _task->overruns++;
+    }
+    if (_end - _release > _task->deadline) {
+      _task->misses++;
+    }
+    // Start over with the highest priority on the next call
+    return true;
+  }
+  return false;
+}
+
+
+void Scheduler::idle() {
+  set_sleep_mode(SLEEP_MODE_IDLE);
+
+  noInterrupts();
+  for (byte i = 0; i < m_count; i++) {
+    if (m_tasks[i].triggered) {
+      interrupts();
+      return;
+    }
+  }
+  sleep_enable();
+  // The instruction after sei is executed before any interrupt,
+  // so one arriving right now still wakes the sleep
+  interrupts();
+  sleep_cpu();
+  sleep_disable();
+
+  m_slept = true;
+  m_sleeps++;
+}
+
+
+byte Scheduler::getCount() {
+  return m_count;
+}
+
+
+uint16 Scheduler::getMisses(TaskId_t task) {
+  return m_tasks[task].misses;
+}
+
+
+uint16 Scheduler::getOverruns(TaskId_t task) {
+  return m_tasks[task].overruns;
+}
+
+
+uint16 Scheduler::getSleeps() {
+  return m_sleeps;
+}
+
+
+uint16 Scheduler::getWakeups() {
+  return m_wakeups;
+}
+
+
+uint16 Scheduler::getWakeLatencyAvg() {
+  if (0 == m_wakeups) {
+    return 0;
+  }
+  return m_wakeLatencySum / m_wakeups;
+}
+
+
+uint16 Scheduler::getWakeLatencyMax() {
+  return m_wakeLatencyMax;
+}
+
+
+uint16 Scheduler::getLatencyMax() {
+  return m_latencyMax;
+}
+
+
+void Scheduler::resetStats() {
+  for (byte i = 0; i < m_count; i++) {
+    m_tasks[i].misses   = 0;
+    m_tasks[i].overruns = 0;
+  }
+}
+
+
+void Scheduler::resetSleepStats() {
+  m_sleeps         = 0;
+  m_wakeups        = 0;
+  m_wakeLatencySum = 0;
+  m_wakeLatencyMax = 0;
+  m_latencyMax     = 0;
+}
@@ -0,0 +1,93 @@
+// scheduler.h
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include "Arduino.h"
+#include "./settings.h"
+
+typedef struct Task {
+  void          (*run)();
+  unsigned long period;       // us, 0: only run when triggered
+  unsigned long deadline;     // us after the release
+  unsigned long budget;       // us of run time
+  unsigned long release;      // us, time of the latest release
+  volatile bool triggered;
+  volatile unsigned long triggerTime;
+  uint16        misses;       // finished after the deadline
+  uint16        overruns;     // ran longer than the budget
+} Task_t;
+
+/*!
+ *  Fixed priority, run to completion task scheduler
+ *
+ *  Tasks are released periodically or by trigger(), e.g. from an ISR.
+ *  update() runs the ready task added first, so the order of add()
+ *  calls gives the priorities and has to follow TaskId_t.
+ *  With no task ready, idle() sleeps until the next interrupt. The delay
+ *  from trigger() to the start of a task is tracked separately for
+ *  tasks released while sleeping, to tell the cost of waking up.
+ */
+class Scheduler {
+ public:
+  Scheduler();
+
+  bool   add(void (*run)(),
+             unsigned long period,
+             unsigned long deadline,
+             unsigned long budget);
+  /*! Release a task right away, safe to call from an ISR */
+  void   trigger(TaskId_t task);
+  /*! Run the ready task of the highest priority,
+   *  returns false if no task was ready
+   */
+  bool   update();
+  /*! Sleep in SLEEP_MODE_IDLE unless a task has been triggered */
+  void   idle();
+
+  byte   getCount();
+  uint16 getMisses(TaskId_t task);
+  uint16 getOverruns(TaskId_t task);
+  uint16 getSleeps();
+  /*! Triggered tasks started after sleeping */
+  uint16 getWakeups();
+  /*! us from trigger() to the task's start after sleeping */
+  uint16 getWakeLatencyAvg();
+  uint16 getWakeLatencyMax();
+  /*! us from trigger() to the task's start without sleeping */
+  uint16 getLatencyMax();
+  void   resetStats();
+  void   resetSleepStats();
+
+ private:
+  Task_t m_tasks[SCHEDULER_TASKS];
+  byte   m_count;
+
+  bool     m_slept;
+  uint16   m_sleeps;
+  uint16   m_wakeups;
+  uint32_t m_wakeLatencySum;
+  uint16   m_wakeLatencyMax;
+  uint16   m_latencyMax;
+};
+
+#endif  // SCHEDULER_H_
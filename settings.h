@@ -27,6 +27,8 @@ This file is part of AYAB.
  */
 
 //  #define DBG_NOMACHINE  // Turn on to use DBG_BTN as EOL Trigger
+//  #define PATTERNSTORE_SPIFLASH  // Turn on to store patterns in an SPI flash
+//  #define TRACE  // Turn on to record needle events for reqTrace
 
 #ifdef KH910
   #warning USING MACHINETYPE KH910
@@ -61,12 +63,23 @@ This file is part of AYAB.
 // DO NOT TOUCH
 #define FW_VERSION_MAJ 0
 #define FW_VERSION_MIN 95
-#define API_VERSION 5 // for message description, see below
+#define API_VERSION 6 // for message description, see below
 
 #define SERIAL_BAUDRATE 115200
 
 #define BEEPDELAY 50  // ms
 
+// Outgoing message queue
+#define TXQUEUE_HIGH_SIZE   96  // bytes, line requests and confirmations
+#define TXQUEUE_LOW_SIZE    48  // bytes, state reports
+#define TXQUEUE_MAX_PAYLOAD 32  // bytes
+
+// Log entries waiting to be sent, see debug.h
+#define LOGGER_SIZE         48  // bytes
+
+// Events kept by the trace ring, about the last ten needles, see trace.h
+#define TRACE_EVENTS        24
+
 // Pin Assignments
 #define EOL_PIN_R 0  // Analog
 #define EOL_PIN_L 1  // Analog
@@ -83,8 +96,20 @@ This file is part of AYAB.
 
 #define DBG_BTN_PIN 7  // DEBUG BUTTON
 
+#define SPIFLASH_CS_PIN 10  // optional pattern storage
+
 // Machine constants
 #define NUM_NEEDLES    200
+#define LINEBUFFER_LEN 25  // bytes, one bit per needle
+#define LINEBUFFER_ROWS 4  // line being knitted plus lines received ahead
+#define ROWCACHE_SLOTS  4  // recently used lines, addressed by hash
+#define MOTIF_MAX_BYTES 64 // motif for on-device repeats, rows byte aligned
+#define COLOURS_MAX     8  // colours of a colour indexed line
+#define JOBQUEUE_LEN    4  // jobs knitted back to back after the current one
+#define SCHEDULER_TASKS 6  // tasks of the main loop, see TaskId_t
+#define HISTOGRAM_BUCKETS 12 // log2 buckets of us, the last one up from 2ms
+#define REPORT_HALL_DEADBAND 4 // ADC counts, smaller hall changes not reported
+#define REPORT_FULL_EVERY 20   // delta state reports between complete ones
 #define END_LEFT       0
 #define END_RIGHT      255
 #define END_OF_LINE_OFFSET_L 12
@@ -94,18 +119,50 @@ This file is part of AYAB.
 #define uint16 unsigned int
 
 typedef enum AYAB_API {
-    reqStart_msgid    = 0x01,
-    cnfStart_msgid    = 0xC1,
+    reqStart_msgid    = 0x01,  // id, start, stop, reporting, [source, source params]
+    cnfStart_msgid    = 0xC1,  // id, success, knitting from the stored pattern
     reqLine_msgid     = 0x82,
     cnfLine_msgid     = 0x42,
+    cnfLineBatch_msgid = 0x12, // id, first line, count, count * 25 bytes, flags
+    cnfLineXor_msgid  = 0x52,  // id, line, (byte index, xor mask)*, flags, crc8
+    cnfLineRle_msgid  = 0x62,  // id, line, first byte, (count, value)*, flags, crc8
+    cnfLineRange_msgid = 0x72, // id, line, start, stop, bytes start/8..stop/8, flags, crc8
+    cnfLineCached_msgid = 0x22, // id, line, line number it was cached as,
+                                // hash (2), flags, crc8
+    cnfLineColour_msgid = 0x32, // id, line, colour indices (2 or 4 bits), flags, crc8
+    cnfLineLace_msgid = 0x02,   // id, line, lace chart (2 bits), flags, crc8
     reqInfo_msgid     = 0x03,
     cnfInfo_msgid     = 0xC3,
     reqTest_msgid     = 0x04,
     cnfTest_msgid     = 0xC4,
     indState_msgid    = 0x84,
-    debug_msgid       = 0xFF
+    reqStats_msgid    = 0x05,  // id, group
+    cnfStats_msgid    = 0xC5,  // id, group, counters of that group
+    indEndWork_msgid  = 0x86,  // id, lines knitted (2), jobs still queued,
+                               // job time (4, ms), waiting for lines (4, ms),
+                               // needles selected (4), NextJob_t bits
+    reqStore_msgid    = 0x07,  // id, offset (2), pattern container bytes
+    cnfStore_msgid    = 0xC7,  // id, success, bytes received (2)
+    reqQueue_msgid    = 0x08,  // id, [start, stop, carriage, source, [hash (2)]]
+    cnfQueue_msgid    = 0xC8,  // id, success, jobs queued
+    reqTrace_msgid    = 0x09,  // id, TraceAction_t, first event (TraceFetch)
+    cnfTrace_msgid    = 0xC9,  // id, success, events in the trace
+    indTrace_msgid    = 0x89,  // id, index of the first event, events
+    reqReport_msgid   = 0x0A,  // id, ReportField_t bits, min interval (2, ms)
+    cnfReport_msgid   = 0xCA,  // id, success
+    indStateDelta_msgid = 0x8A, // id, ReportField_t bits, values of these
+    indRow_msgid      = 0x8B,  // id, lines knitted (2), row time (2, ms),
+                               // speed avg, peak (2 each, needles/s),
+                               // waiting for the line (2, ms), needles selected
+    reqPing_msgid     = 0x0C,  // id, host time (4)
+    cnfPing_msgid     = 0xCC,  // id, host time (4), received (4, us),
+                               // transmitted (4, us)
+    debug_msgid       = 0xFF   // id, dropped, (token, args (2)*)*
 } AYAB_API_t;
 
+#define CNFPING_LEN  13  // bytes
+#define CNFPING_SENT 9   // offset of the transmit time in cnfPing
+
 typedef enum Direction {
   NoDirection = 0,
   Left        = 1,
@@ -127,6 +184,91 @@ typedef enum Beltshift {
   Lace_Shifted = 4
 } Beltshift_t;
 
+typedef enum TxPriority {
+  TxHigh = 0,  // never dropped, sent first
+  TxLow  = 1   // oldest dropped when the queue is full
+} TxPriority_t;
+
+typedef enum LineSource {
+  SourceHost  = 0,  // every line requested with reqLine
+  SourceMotif = 1,  // lines repeated from a motif sent with reqStart
+  SourceColour = 2, // colour indexed lines, passes derived on the device
+  SourceLace  = 3,  // lace chart lines, transfer and knit passes on the device
+  SourceStored = 4  // lines decoded from a pattern stored with reqStore,
+                    // picked by its hash (2) if given
+} LineSource_t;
+
+typedef enum NextJob {
+  NextJobStarted  = 0x01,  // a queued job follows
+  NextJobFromHost = 0x02,  // its hash is not stored, lines come with reqLine
+  NextJobSkipped  = 0x04   // queued jobs dropped, nothing stored to knit from
+} NextJob_t;
+
+typedef enum ColourMode {
+  ColourClassic    = 0,  // one pass per colour
+  ColourBirdseye   = 1,  // one pass per colour, order reversed every other line
+  ColourMiddleTwice = 2  // first and last colour once, the others twice
+} ColourMode_t;
+
+typedef enum StatsGroup {
+  StatsRowCache = 0,
+  StatsScheduler = 1,  // deadline misses, budget overruns (2 each) per task
+  StatsSleep     = 2,  // sleeps, wakeups, wake latency avg, max,
+                       // latency max without sleeping (2 each, us)
+  // Histograms of Latency_t, HISTOGRAM_BUCKETS counts (2 each)
+  StatsLatencyIsr       = 3,
+  StatsLatencyFsm       = 4,
+  StatsLatencySolenoids = 5,
+  StatsLatencyRx        = 6,
+  StatsLatencyEdge      = 7,
+  StatsTxQueue          = 8   // low priority messages dropped (2)
+} StatsGroup_t;
+
+typedef enum Latency {
+  LatencyIsr       = 0,  // Knitter::isr()
+  LatencyFsm       = 1,  // one pass of Knitter::fsm()
+  LatencySolenoids = 2,  // Solenoids::write()
+  LatencyRx        = 3,  // PacketSerial::update()
+  LatencyEdge      = 4,  // encoder edge to needle solenoid set
+  LatencyCount     = 5
+} Latency_t;
+
+typedef enum TaskId {
+  TaskFsm       = 0,  // highest priority
+  TaskRx        = 1,
+  TaskTx        = 2,
+  TaskBeeper    = 3,
+  TaskTelemetry = 4,
+  TaskAdc       = 5
+} TaskId_t;
+
+typedef enum ReportField {
+  // In order of their values in indStateDelta
+  ReportHallLeft  = 0x01,  // (2)
+  ReportHallRight = 0x02,  // (2)
+  ReportCarriage  = 0x04,
+  ReportPosition  = 0x08,
+  ReportDirection = 0x10,
+  ReportAll       = 0x1F
+} ReportField_t;
+
+typedef enum TraceEvent {
+  // Arguments a, b of the event
+  TraceEdge          = 0,  // position, direction
+  TraceHall          = 1,  // sensor, carriage << 8 | belt shift
+  TraceSolenoids     = 2,  // expanders written (bit 0 low, 1 high), state
+  TraceLineRequested = 3,  // line number
+  TraceLineAccepted  = 4,  // line number
+  TraceStateChanged  = 5   // old state, new state
+} TraceEvent_t;
+
+typedef enum TraceAction {
+  TraceFreeze  = 0,  // stop recording, cnfTrace tells the events kept
+  TraceRestart = 1,  // drop the events and record again
+  TraceFetch   = 2   // index of the first event, indTrace of the events
+                     // from there on, none past the last one
+} TraceAction_t;
+
 typedef enum OpState {
   s_init    = 0,
   s_ready   = 1,
@@ -22,10 +22,13 @@ This file is part of AYAB.
 
 #include "Arduino.h"
 #include "./solenoids.h"
+#include "./histogram.h"
+#include "./trace.h"
 
 // Determine board type
-#if defined(__AVR_ATmega168__) || defined(__AVR_ATmega328P__)
-  // Regular Arduino
+#if defined(__AVR_ATmega168__) || defined(__AVR_ATmega328P__) \
+    || defined(AYAB_HOST)
+  // Regular Arduino, or the simulated one of the host build
   #warning Using Hardware I2C
   #ifndef HARD_I2C
     #define HARD_I2C
@@ -93,8 +96,13 @@ void Solenoids::setSolenoids(uint16 state) {
  * Writes to the I2C port expanders
  * Low level function, mapping to actual wiring
  * is done here.
+ * Both expanders are always written, one that was reset or missed
+ * a write gets the right state again with the next call.
  */
 void Solenoids::write(uint16 newState) {
+  TRACE_EVENT(TraceSolenoids, 0x03, newState);
+  unsigned long _start = micros();
+
   #ifdef HARD_I2C
     mcp_0.writeGPIO(lowByte(newState));
     mcp_1.writeGPIO(highByte(newState));
@@ -106,4 +114,5 @@ void Solenoids::write(uint16 newState) {
     Wire.send(highByte(newState));
     Wire.endTransmission();
   #endif
+  latencies[LatencySolenoids].add(micros() - _start);
 }
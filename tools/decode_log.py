@@ -0,0 +1,132 @@
+#!/usr/bin/env python
+# decode_log.py
+#
+# This file is part of AYAB.
+#
+#    AYAB is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    AYAB is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+#
+#    Copyright 2013-2015 Christian Obersteiner, Andreas Mueller
+#    http://ayab-knitting.com
+
+"""Turn debug_msgid packets of the firmware back into text.
+
+The token table is read from debug.h. Packets come either from a serial
+port (needs pyserial) or as hex strings, one per line, on stdin:
+
+    decode_log.py --port /dev/ttyACM0
+    echo "ff 00 02 00 05 03 00 07 00 06" | decode_log.py
+"""
+
+import argparse
+import os
+import re
+import sys
+
+DEBUG_MSGID = 0xFF
+
+SLIP_END = 0xC0
+SLIP_ESC = 0xDB
+SLIP_ESC_END = 0xDC
+SLIP_ESC_ESC = 0xDD
+
+
+def read_tokens(path):
+    """List of (name, argc, text) in token order."""
+    with open(path) as f:
+        source = f.read()
+    tokens = []
+    for name, argc, text in re.findall(r'X\((\w+),\s*(\d+),\s*"([^"]*)"\)',
+                                       source):
+        if text.count("%") != int(argc):
+            sys.exit("%s: %s has %s arguments but text \"%s\""
+                     % (path, name, argc, text))
+        tokens.append((name, int(argc), text))
+    return tokens
+
+
+def decode(payload, tokens):
+    """Lines of text for one debug packet."""
+    if not payload or payload[0] != DEBUG_MSGID:
+        return []
+    lines = []
+    if len(payload) > 1 and payload[1]:
+        lines.append("(%d entries dropped)" % payload[1])
+
+    i = 2
+    while i < len(payload):
+        token = payload[i]
+        if token >= len(tokens):
+            lines.append("unknown token %d, rest: %s"
+                         % (token, bytes(payload[i:]).hex()))
+            break
+        name, argc, text = tokens[token]
+        if i + 1 + 2 * argc > len(payload):
+            lines.append("%s: truncated, rest: %s"
+                         % (name, bytes(payload[i:]).hex()))
+            break
+        args = []
+        for n in range(argc):
+            offset = i + 1 + 2 * n
+            args.append((payload[offset] << 8) | payload[offset + 1])
+        lines.append("%s: %s" % (name, text % tuple(args)))
+        i += 1 + 2 * argc
+    return lines
+
+
+def slip_packets(port):
+    """Packets read from a SLIP framed serial port."""
+    packet = bytearray()
+    escaped = False
+    while True:
+        for byte in bytearray(port.read(1)):
+            if escaped:
+                packet.append({SLIP_ESC_END: SLIP_END,
+                               SLIP_ESC_ESC: SLIP_ESC}.get(byte, byte))
+                escaped = False
+            elif byte == SLIP_ESC:
+                escaped = True
+            elif byte == SLIP_END:
+                if packet:
+                    yield bytes(packet)
+                packet = bytearray()
+            else:
+                packet.append(byte)
+
+
+def main():
+    default_header = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                  os.pardir, "debug.h")
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--header", default=default_header,
+                        help="debug.h with the token table")
+    parser.add_argument("--port", help="serial port of the AYAB device")
+    parser.add_argument("--baud", type=int, default=115200)
+    options = parser.parse_args()
+
+    tokens = read_tokens(options.header)
+
+    if options.port:
+        import serial
+        packets = slip_packets(serial.Serial(options.port, options.baud))
+    else:
+        packets = (bytearray.fromhex(line) for line in sys.stdin
+                   if line.strip())
+
+    for packet in packets:
+        for line in decode(bytearray(packet), tokens):
+            print(line)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,97 @@
+// trace.cpp
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#include "Arduino.h"
+#include "./trace.h"
+
+#ifdef TRACE
+Trace trace;
+#endif
+
+
+Trace::Trace() {
+  restart();
+}
+
+
+void Trace::record(TraceEvent_t event, byte a, uint16 b) {
+  uint16_t _time = micros() >> 2;
+
+  noInterrupts();
+  if (!m_frozen) {
+    Event_t* _event = &m_events[m_next];
+    _event->time  = _time;
+    _event->event = event;
+    _event->a     = a;
+    _event->b     = b;
+    m_next = (m_next + 1) % TRACE_EVENTS;
+    if (m_count < TRACE_EVENTS) {
+      m_count++;
+    }
+  }
+  interrupts();
+}
+
+
+byte Trace::freeze() {
+  noInterrupts();
+  m_frozen = true;
+  interrupts();
+  return m_count;
+}
+
+
+void Trace::restart() {
+  noInterrupts();
+  m_next   = 0;
+  m_count  = 0;
+  m_frozen = false;
+  interrupts();
+}
+
+
+bool Trace::dump(TxQueue* txQueue, byte first) {
+  if (!m_frozen) {
+    return false;
+  }
+
+  uint8_t payload[TXQUEUE_MAX_PAYLOAD];
+  byte    _size = 2;
+  payload[0] = indTrace_msgid;
+  payload[1] = first;
+
+  // Oldest event first, none past the end of the trace
+  byte _index = (m_next + TRACE_EVENTS - m_count + first) % TRACE_EVENTS;
+  for (byte i = first;
+       i < m_count && _size + TRACE_EVENT_SIZE <= TXQUEUE_MAX_PAYLOAD;
+       i++) {
+    Event_t* _event = &m_events[_index];
+    payload[_size++] = highByte(_event->time);
+    payload[_size++] = lowByte(_event->time);
+    payload[_size++] = _event->event;
+    payload[_size++] = _event->a;
+    payload[_size++] = highByte(_event->b);
+    payload[_size++] = lowByte(_event->b);
+    _index = (_index + 1) % TRACE_EVENTS;
+  }
+  txQueue->send(payload, _size, TxLow);
+  return true;
+}
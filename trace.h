@@ -0,0 +1,86 @@
+// trace.h
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include "Arduino.h"
+#include "./settings.h"
+#include "./txqueue.h"
+
+#define TRACE_EVENT_SIZE 6  // bytes: time (2), TraceEvent_t, a, b (2)
+
+/*!
+ *  Ring of the latest needle events, to look into the last needles
+ *  before something went wrong
+ *
+ *  Events are recorded all the time and overwrite the oldest ones.
+ *  freeze() stops recording. The host then fetches the events, oldest
+ *  first, by the index of the first event of each indTrace packet.
+ *  The packets are of low priority so that they do not hold up the line
+ *  requests; one lost on a busy link is simply asked for again.
+ *
+ *  The ring does not hold a whole row. Every needle records an edge and
+ *  a solenoid write, so TRACE_EVENTS = 24 covers about the last ten
+ *  needles; a row of 200 needles would take 2.4kB, more than the RAM of
+ *  an Uno. Freeze as close to the fault as possible.
+ *  Times are micros() / 4, the resolution of micros() on a 16MHz AVR,
+ *  and wrap around after 262ms. Only the time between neighbouring
+ *  events is meaningful, and only if it is below 262ms, e.g. not
+ *  across a pause of the carriage.
+ */
+class Trace {
+ public:
+  Trace();
+
+  /*! Safe to call from an ISR, ignored while frozen */
+  void record(TraceEvent_t event, byte a, uint16 b);
+
+  /*! Stop recording, returns the number of events to dump */
+  byte freeze();
+  void restart();
+  /*! Send the events of a frozen trace from first on, as many as fit
+   *  into one packet, false if not frozen
+   */
+  bool dump(TxQueue* txQueue, byte first);
+
+ private:
+  typedef struct Event {
+    uint16_t time;
+    byte     event;
+    byte     a;
+    uint16_t b;
+  } Event_t;
+
+  Event_t m_events[TRACE_EVENTS];
+  byte    m_next;
+  byte    m_count;
+  bool    m_frozen;
+};
+
+#ifdef TRACE
+  extern Trace trace;
+  #define TRACE_EVENT(event, a, b) trace.record((event), (a), (b))
+#else
+  #define TRACE_EVENT(event, a, b)
+#endif
+
+#endif  // TRACE_H_
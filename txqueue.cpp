@@ -0,0 +1,251 @@
+// txqueue.cpp
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#include "Arduino.h"
+#include "./txqueue.h"
+
+// Usable space in the hardware serial TX buffer,
+// SERIAL_BUFFER_SIZE of the Arduino 1.0.6 core is not exported
+#ifdef SERIAL_TX_BUFFER_SIZE
+  #define SERIAL_TX_CAPACITY (SERIAL_TX_BUFFER_SIZE - 1)
+#else
+  #define SERIAL_TX_CAPACITY 63
+#endif
+
+// us per byte on the line: start, 8 data and stop bit, rounded up
+#define SERIAL_BYTE_TIME (10000000UL / SERIAL_BAUDRATE + 1)
+
+
+TxRing::TxRing() {
+  m_buffer   = NULL;
+  m_capacity = 0;
+  m_head     = 0;
+  m_used     = 0;
+}
+
+
+void TxRing::init(byte* buffer, byte capacity) {
+  m_buffer   = buffer;
+  m_capacity = capacity;
+  m_head     = 0;
+  m_used     = 0;
+}
+
+
+bool TxRing::push(const uint8_t* payload, byte size) {
+  if (size + 1 > m_capacity - m_used) {
+    return false;
+  }
+
+  byte _index = m_head + m_used;
+  if (_index >= m_capacity) {
+    _index -= m_capacity;
+  }
+  m_buffer[_index] = size;
+  for (byte i = 0; i < size; i++) {
+    if (++_index >= m_capacity) {
+      _index = 0;
+    }
+    m_buffer[_index] = payload[i];
+  }
+  m_used += size + 1;
+  return true;
+}
+
+
+byte TxRing::peek(uint8_t* payload) {
+  byte _size = peekSize();
+
+  byte _index = m_head;
+  for (byte i = 0; i < _size; i++) {
+    if (++_index >= m_capacity) {
+      _index = 0;
+    }
+    payload[i] = m_buffer[_index];
+  }
+  return _size;
+}
+
+
+byte TxRing::peekSize() {
+  return (0 == m_used) ? 0 : m_buffer[m_head];
+}
+
+
+void TxRing::pop() {
+  if (0 == m_used) {
+    return;
+  }
+  byte _length = m_buffer[m_head] + 1;
+  m_head += _length;
+  if (m_head >= m_capacity) {
+    m_head -= m_capacity;
+  }
+  m_used -= _length;
+}
+
+
+bool TxRing::isEmpty() {
+  return (0 == m_used);
+}
+
+
+TxQueue::TxQueue() {}
+
+TxQueue::TxQueue(SLIPPacketSerial* packetSerial) {
+  m_packetSerial = packetSerial;
+  m_txBacklog    = 0;
+  m_txTime       = 0;
+  m_high.init(m_highBuffer, TXQUEUE_HIGH_SIZE);
+  m_low.init(m_lowBuffer, TXQUEUE_LOW_SIZE);
+  m_dropped = 0;
+}
+
+
+bool TxQueue::send(const uint8_t* payload, byte size,
+                   TxPriority_t priority, byte stampAt) {
+  if (0 == size || (stampAt && stampAt + 4 > size)) {
+    return false;
+  }
+
+  if (size > TXQUEUE_MAX_PAYLOAD) {
+    // Too large to be queued, keep the order of pending
+    // high priority messages and send it right away
+    while (transmit(&m_high, true)) {}
+    m_packetSerial->send(payload, size);
+    written(size);
+    return true;
+  }
+
+  uint8_t _entry[TXQUEUE_MAX_PAYLOAD + 1];
+  _entry[0] = stampAt;
+  memcpy(&_entry[1], payload, size);
+
+  if (TxHigh == priority) {
+    // Never lose a line request or confirmation,
+    // wait for the link instead
+    while (!m_high.push(_entry, size + 1)) {
+      transmit(&m_high, true);
+    }
+  } else {
+    // State reports are superseded by newer ones anyway
+    while (!m_low.push(_entry, size + 1)) {
+      m_low.pop();
+      if (m_dropped < 0xFFFF) {
+        m_dropped++;
+      }
+    }
+  }
+  return true;
+}
+
+
+void TxQueue::update() {
+  while (transmit(&m_high, false)) {}
+
+  if (m_high.isEmpty()) {
+    while (transmit(&m_low, false)) {}
+  }
+}
+
+
+bool TxQueue::isReady() {
+  if (!m_high.isEmpty()) {
+    return fits(&m_high);
+  }
+  return !m_low.isEmpty() && fits(&m_low);
+}
+
+
+uint16 TxQueue::getDropped() {
+  return m_dropped;
+}
+
+
+void TxQueue::resetStats() {
+  m_dropped = 0;
+}
+
+
+/*
+ * PRIVATE METHODS
+ */
+bool TxQueue::fits(TxRing* ring) {
+  // Worst case SLIP size plus packet marker; messages which can never
+  // fit wait for an empty TX buffer instead
+  int _needed = SLIP::getEncodedBufferSize(ring->peekSize() - 1) + 1;
+  if (_needed > SERIAL_TX_CAPACITY) {
+    _needed = SERIAL_TX_CAPACITY;
+  }
+  return SERIAL_TX_CAPACITY - txBacklog() >= _needed;
+}
+
+
+/*
+ * The 1.0.6 core has no availableForWrite(), so the bytes still in the
+ * TX buffer are estimated from what was written and the time the UART
+ * needed to send it. Worst case SLIP sizes make this an upper bound.
+ */
+int TxQueue::txBacklog() {
+  unsigned long _now     = micros();
+  unsigned long _drained = (_now - m_txTime) / SERIAL_BYTE_TIME;
+  m_txBacklog = (_drained < m_txBacklog) ? m_txBacklog - _drained : 0;
+  // Keep the part of a byte time not accounted for yet
+  m_txTime = _now - (_now - m_txTime) % SERIAL_BYTE_TIME;
+  return m_txBacklog;
+}
+
+
+void TxQueue::written(byte size) {
+  // More than fits has waited in Serial.write() for the rest
+  m_txBacklog = min(txBacklog() + (int)SLIP::getEncodedBufferSize(size) + 1,
+                    SERIAL_TX_CAPACITY);
+}
+
+
+bool TxQueue::transmit(TxRing* ring, bool blocking) {
+  byte _size = ring->peekSize();
+  if (0 == _size) {
+    return false;
+  }
+
+  if (!blocking && !fits(ring)) {
+    return false;
+  }
+
+  uint8_t _entry[TXQUEUE_MAX_PAYLOAD + 1];
+  ring->peek(_entry);
+  if (0 != _entry[0]) {
+    stamp(&_entry[1], _entry[0]);
+  }
+  m_packetSerial->send(&_entry[1], _size - 1);
+  written(_size - 1);
+  ring->pop();
+  return true;
+}
+
+
+void TxQueue::stamp(uint8_t* payload, byte stampAt) {
+  unsigned long _now = micros();
+  for (byte i = 0; i < 4; i++) {
+    payload[stampAt + 3 - i] = (_now >> (8 * i)) & 0xFF;
+  }
+}
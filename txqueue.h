@@ -0,0 +1,98 @@
+// txqueue.h
+/*
+This file is part of AYAB.
+
+    AYAB is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AYAB is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AYAB.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2013-2015 Christian Obersteiner, Andreas Müller
+    http://ayab-knitting.com
+*/
+
+#ifndef TXQUEUE_H_
+#define TXQUEUE_H_
+
+#include "Arduino.h"
+#include "./settings.h"
+
+#include "./libraries/PacketSerial/src/PacketSerial.h"
+
+/*!
+ *  Ring buffer of length-prefixed messages
+ */
+class TxRing {
+ public:
+  TxRing();
+
+  void init(byte* buffer, byte capacity);
+  bool push(const uint8_t* payload, byte size);
+  /*! Copy the oldest message to payload, returns its size (0 if empty) */
+  byte peek(uint8_t* payload);
+  /*! Size of the oldest message (0 if empty) */
+  byte peekSize();
+  void pop();
+  bool isEmpty();
+
+ private:
+  byte* m_buffer;
+  byte  m_capacity;
+  byte  m_head;
+  byte  m_used;
+};
+
+/*!
+ *  Non-blocking, prioritized queue for outgoing packets
+ *
+ *  Messages are only handed to the serial port when they fit into its
+ *  TX buffer, so a congested link never stalls the caller.
+ *  High priority messages always leave before low priority ones.
+ *  Queued messages are stored with their stamp offset in front.
+ */
+class TxQueue {
+ public:
+  TxQueue();
+  TxQueue(SLIPPacketSerial*);
+
+  /*! stampAt: offset of 4 bytes that get micros() at the time of
+   *  transmission, big endian, 0 for none. Messages larger than
+   *  TXQUEUE_MAX_PAYLOAD are sent right away and not stamped.
+   */
+  bool send(const uint8_t* payload, byte size,
+            TxPriority_t priority = TxHigh, byte stampAt = 0);
+  /*! Hand queued messages to the serial port, call from loop() */
+  void update();
+  /*! The next message fits into the serial TX buffer */
+  bool isReady();
+  /*! Number of low priority messages dropped since resetStats() */
+  uint16 getDropped();
+  void   resetStats();
+
+ private:
+  SLIPPacketSerial* m_packetSerial;
+  uint16            m_txBacklog;  // bytes in the serial TX buffer, estimated
+  unsigned long     m_txTime;     // us, m_txBacklog last updated
+
+  TxRing m_high;
+  TxRing m_low;
+  byte   m_highBuffer[TXQUEUE_HIGH_SIZE];
+  byte   m_lowBuffer[TXQUEUE_LOW_SIZE];
+  uint16 m_dropped;
+
+  bool fits(TxRing* ring);
+  int  txBacklog();
+  void written(byte size);
+  bool transmit(TxRing* ring, bool blocking);
+  void stamp(uint8_t* payload, byte stampAt);
+};
+
+#endif  // TXQUEUE_H_